@@ -0,0 +1,128 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_ASYNC_HPP__
+#define __PR_PX_ASYNC_HPP__
+
+#include <PxPhysicsAPI.h>
+#include <pragma/physics/raytraces.h>
+#include <coroutine>
+#include <condition_variable>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cassert>
+
+namespace pragma::physics {
+	class PhysXEnvironment;
+	enum class AsyncQueryType : uint8_t { Overlap = 0, RayCast, Sweep };
+	struct AsyncQueryResult {
+		bool hit = false;
+		std::vector<TraceResult> results {};
+	};
+
+	// Continuations that have been posted from any thread are resumed on the game thread
+	// the next time RunPending is called.
+	class PhysXGameThreadExecutor {
+	  public:
+		void Post(std::coroutine_handle<> handle);
+		// Must only be called from the game thread. Returns the number of resumed continuations.
+		uint32_t RunPending();
+	  private:
+		std::mutex m_mutex;
+		std::vector<std::coroutine_handle<>> m_pending {};
+		std::vector<std::coroutine_handle<>> m_running {};
+	};
+
+	class PhysXAsyncQueryBatch;
+	class AsyncQueryTask : public physx::PxLightCpuTask {
+	  public:
+		AsyncQueryTask(PhysXAsyncQueryBatch &batch, uint32_t start, uint32_t end);
+		virtual void run() override;
+		virtual void release() override;
+		virtual const char *getName() const override;
+	  private:
+		PhysXAsyncQueryBatch &m_batch;
+		uint32_t m_start = 0;
+		uint32_t m_end = 0;
+	};
+
+	class PhysXAsyncQueryBatch {
+	  public:
+		PhysXAsyncQueryBatch(PhysXEnvironment &env, AsyncQueryType type, std::vector<TraceData> &&data);
+		PhysXEnvironment &env;
+		AsyncQueryType type;
+		std::vector<TraceData> data;
+		std::vector<AsyncQueryResult> results;
+		// Profiler tag of the thread that has issued the queries
+		const char *tag = nullptr;
+		std::coroutine_handle<> continuation {};
+		// Tasks must not be moved once they have been submitted
+		std::deque<AsyncQueryTask> tasks {};
+		std::atomic<uint32_t> numPendingTasks {0};
+	};
+
+	// Shared state of all asynchronous operations of an environment
+	struct PhysXAsyncState {
+		PhysXGameThreadExecutor executor {};
+		std::vector<PhysXAsyncQueryBatch *> queuedBatches {};
+
+		std::mutex inFlightMutex;
+		std::condition_variable inFlightCondition;
+		uint32_t numTasksInFlight = 0;
+
+		std::vector<std::coroutine_handle<>> stepContinuations {};
+		bool stepInFlight = false;
+		float stepTimeStep = 0.f;
+		float stepFixedTimeStep = 0.f;
+		uint32_t numRemainingSubSteps = 0;
+	};
+
+	// The awaitables are part of the frame of the awaiting coroutine and own the query batch, which the worker threads
+	// write their results into. A coroutine that is suspended on an asynchronous query or step must therefore run to
+	// completion, destroying it before it has been resumed is not allowed.
+	class AsyncQueryAwaitable {
+	  public:
+		AsyncQueryAwaitable(PhysXEnvironment &env, AsyncQueryType type, std::vector<TraceData> &&data);
+		AsyncQueryAwaitable(AsyncQueryAwaitable &&) = default;
+		~AsyncQueryAwaitable();
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> handle);
+	  protected:
+		std::unique_ptr<PhysXAsyncQueryBatch> m_batch = nullptr;
+		// True between suspension and resumption of the awaiting coroutine
+		bool m_suspended = false;
+	};
+	// Resumes on the game thread once the query has been completed on a worker thread
+	class AsyncSingleQueryAwaitable : public AsyncQueryAwaitable {
+	  public:
+		using AsyncQueryAwaitable::AsyncQueryAwaitable;
+		AsyncQueryResult await_resume();
+	};
+	// Resumes on the game thread once all queries of the batch have been completed. The queries
+	// are distributed across the worker threads.
+	class AsyncBatchQueryAwaitable : public AsyncQueryAwaitable {
+	  public:
+		using AsyncQueryAwaitable::AsyncQueryAwaitable;
+		std::vector<AsyncQueryResult> await_resume();
+	};
+	// Starts a simulation step without blocking and resumes on the game thread after the results of the last substep have been fetched
+	class AsyncStepAwaitable {
+	  public:
+		AsyncStepAwaitable(PhysXEnvironment &env, float timeStep, float fixedTimeStep);
+		~AsyncStepAwaitable();
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> handle);
+		void await_resume() noexcept { m_suspended = false; }
+	  private:
+		PhysXEnvironment &m_env;
+		float m_timeStep = 0.f;
+		float m_fixedTimeStep = 0.f;
+		bool m_suspended = false;
+	};
+};
+
+#endif
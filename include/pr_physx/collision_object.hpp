@@ -8,6 +8,9 @@
 #include <pragma/physics/collision_object.hpp>
 #include "shape.hpp"
 #include "pr_physx/common.hpp"
+#include "pr_physx/sim_filter_shader.hpp"
+#include "pr_physx/sleep_state.hpp"
+#include <foundation/PxInlineArray.h>
 
 namespace physx {
 	class PxActor;
@@ -53,26 +56,67 @@ namespace pragma::physics {
 		PhysXCollisionObject &m_collisionObject;
 	};
 
+	class PhysXSimulationEventCallback;
 	class PhysXCollisionObject : virtual public pragma::physics::ICollisionObject {
 	  public:
 		friend IEnvironment;
+		friend PhysXSimulationEventCallback;
+		struct TouchingObject {
+			const ICollisionObject *object = nullptr;
+			util::TWeakSharedHandle<ICollisionObject> handle = {};
+		};
+		// Most objects only touch a few other objects at a time, so no heap allocation is required in most cases
+		using TouchingSet = physx::PxInlineArray<TouchingObject, 4>;
 		static PhysXCollisionObject &GetCollisionObject(ICollisionObject &o);
 		static const PhysXCollisionObject &GetCollisionObject(const ICollisionObject &o);
 		PhysXCollisionObject(IEnvironment &env, PhysXUniquePtr<physx::PxActor> actor, IShape &shape);
 		PhysXEnvironment &GetPxEnv() const;
 		physx::PxActor &GetInternalObject() const;
+		// The actor is released once the object has been removed from the world
+		bool HasInternalObject() const;
 		NoCollisionCategoryId DisableSelfCollisions();
 		virtual void GetAABB(Vector3 &min, Vector3 &max) const override;
 		virtual void SetSleepReportEnabled(bool reportEnabled) override;
 		virtual bool IsSleepReportEnabled() const override;
+		virtual void SetContactReportEnabled(bool reportEnabled) override;
 
+		// Triggers only report overlaps with dynamic objects. Static and kinematic objects (e.g. kinematic character controllers
+		// or moving platforms) are ignored, use a ghost object (see PhysXEnvironment::CreateGhostObject) to detect those instead.
 		virtual void SetTrigger(bool bTrigger) override;
 		virtual bool IsTrigger() const override;
 
 		virtual void TransformLocalPose(const umath::Transform &t) override;
 
 		PhysXActorShapeCollection &GetActorShapeCollection() const;
+		// Dense index of this object in the awake bitset of the sleep state tracker
+		PhysXSleepStateTracker::BodyId GetBodyId() const;
+
+		// Synchronizes the contact report flags in the simulation filter data of the shapes with
+		// the contact report state of this object. Pairs have to be re-filtered if they changed.
+		void UpdateContactReportFilterFlags();
+		// The contact report flags can't be changed while the simulation is running, so objects whose
+		// contact report state has changed are queued and synchronized before the next step
+		void MarkContactReportFilterDirty();
+		// Contacts of this object are reported to native systems like the impact damage service,
+		// regardless of whether contact reports are enabled. Every system that requires the reports adds a listener.
+		void AddImpactReportListener();
+		void RemoveImpactReportListener();
+		bool IsImpactReportEnabled() const;
+
+		// Objects that are currently touching this object. The set is updated during fetchResults, so it is
+		// always up to date with the last simulation step. Maintained for all objects, no contact reports are required.
+		const TouchingSet &GetTouchingObjects() const;
+		uint32_t GetTouchingObjectCount() const;
+		// Linear in the number of touching objects. The set is not hashed, since most objects only touch a few others at a time.
+		bool IsTouching(const ICollisionObject &other) const;
 	  protected:
+		void ApplyContactReportFilterFlags();
+		// Removes this object from the touching sets of all objects it is touching and clears its own set
+		void ClearTouchingObjects();
+		// Replaces the shapes of the actor, which has to be a rigid actor
+		void AttachCollisionShape(pragma::physics::IShape *optShape);
+		void ApplyCollisionFilterGroup(CollisionMask group);
+		void ApplyCollisionFilterMask(CollisionMask mask);
 		virtual void Initialize() override;
 		virtual void OnRemove() override;
 		virtual void RemoveWorldObject() override;
@@ -81,6 +125,14 @@ namespace pragma::physics {
 		PhysXUniquePtr<NoCollisionCategory> m_noCollisionCategory = px_null_ptr<NoCollisionCategory>();
 	  private:
 		PhysXUniquePtr<physx::PxActor> m_actor = px_null_ptr<physx::PxActor>();
+		PhysXSimulationFilterFlags m_contactReportFilterFlags = PhysXSimulationFilterFlags::None;
+		uint32_t m_impactReportListenerCount = 0;
+		bool m_contactReportFilterDirty = false;
+		PhysXSleepStateTracker::BodyId m_bodyId = PhysXSleepStateTracker::INVALID_BODY_ID;
+
+		void AddTouchingObject(ICollisionObject &other);
+		void RemoveTouchingObject(const ICollisionObject &other);
+		TouchingSet m_touchingObjects;
 	};
 	class PhysXRigidBody : virtual public pragma::physics::IRigidBody, public PhysXCollisionObject {
 	  public:
@@ -89,6 +141,10 @@ namespace pragma::physics {
 
 		// Collision object
 		virtual void SetContactProcessingThreshold(float threshold) override;
+		// Contacts of this body are only reported once the contact force exceeds the threshold.
+		// A threshold of 0 reports all contacts.
+		void SetContactReportForceThreshold(float threshold);
+		float GetContactReportForceThreshold() const;
 
 		virtual Vector3 GetPos() const override;
 		virtual void SetPos(const Vector3 &pos) override;
@@ -231,6 +287,53 @@ namespace pragma::physics {
 	  protected:
 		PhysXRigidStatic(IEnvironment &env, PhysXUniquePtr<physx::PxActor> actor, IShape &shape);
 	};
+	// Broadphase-only object that doesn't take part in the simulation and is invisible to scene queries.
+	// Its shapes are kinematic triggers, so overlaps are only tracked through trigger notifications
+	// and cached in the touching set, instead of being re-queried every frame.
+	class PhysXGhostObject : virtual public pragma::physics::IGhostObject, public PhysXCollisionObject {
+	  public:
+		friend IEnvironment;
+		physx::PxRigidDynamic &GetInternalObject() const;
+
+		// Objects that currently overlap the ghost object, as of the last simulation step
+		const TouchingSet &GetOverlappingObjects() const;
+		uint32_t GetOverlappingObjectCount() const;
+
+		// Collision object
+		virtual void SetContactProcessingThreshold(float threshold) override;
+
+		virtual Vector3 GetPos() const override;
+		virtual void SetPos(const Vector3 &pos) override;
+		virtual Quat GetRotation() const override;
+		virtual void SetRotation(const Quat &rot) override;
+		virtual umath::Transform GetWorldTransform() override;
+		virtual void SetWorldTransform(const umath::Transform &t) override;
+
+		virtual umath::Transform GetBaseTransform() override;
+		virtual void SetBaseTransform(const umath::Transform &t) override;
+
+		virtual void SetSimulationEnabled(bool b) override;
+		virtual bool IsSimulationEnabled() const override;
+		virtual void SetCollisionsEnabled(bool enabled) override;
+
+		virtual void SetActivationState(ActivationState state) override;
+		virtual ActivationState GetActivationState() const override;
+		virtual bool IsStatic() const override;
+		virtual void SetStatic(bool b) override;
+		virtual void WakeUp(bool forceActivation = false) override;
+		virtual void PutToSleep() override;
+		virtual void SetCCDEnabled(bool b) override;
+		//
+	  protected:
+		PhysXGhostObject(IEnvironment &env, PhysXUniquePtr<physx::PxActor> actor, IShape &shape);
+		virtual void ApplyCollisionShape(pragma::physics::IShape *optShape) override;
+	  private:
+		// Collision object
+		virtual void DoSetCollisionFilterGroup(CollisionMask group) override;
+		virtual void DoSetCollisionFilterMask(CollisionMask mask) override;
+		//
+		void SetGlobalPose(const physx::PxTransform &pose);
+	};
 	class PhysXSoftBody : virtual public pragma::physics::ISoftBody, public PhysXCollisionObject {
 	  public:
 		friend IEnvironment;
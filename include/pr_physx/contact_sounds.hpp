@@ -0,0 +1,104 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_CONTACT_SOUNDS_HPP__
+#define __PR_PX_CONTACT_SOUNDS_HPP__
+
+#include "pr_physx/common.hpp"
+#include <pragma/physics/collision_object.hpp>
+#include <pragma/physics/phys_material.hpp>
+#include <mathutil/uvec.h>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+namespace pragma::physics {
+	class PhysXEnvironment;
+	class PhysXMaterial;
+
+	// Turns the contacts of registered bodies into impact and scrape sound events. Events are coalesced per body,
+	// material pair and event type, rate-limited and capped to a budget per step, so large piles of objects
+	// don't flood the audio system.
+	class PhysXContactSoundService {
+	  public:
+		enum class EventType : uint8_t { Impact = 0u, Scrape };
+		struct Settings {
+			// Minimum change in relative velocity along the contact normal for an impact
+			float minImpactSpeed = 1.f;
+			// Minimum relative velocity along the contact surface for a scrape
+			float minScrapeSpeed = 0.5f;
+			// Minimum time (in seconds) between two events of the same type for the same body and material pair
+			float minInterval = 0.1f;
+			// Maximum number of events per step, the most intense events are kept
+			uint32_t maxEventsPerStep = 32;
+		};
+		struct SoundEvent {
+			EventType type = EventType::Impact;
+			util::TWeakSharedHandle<ICollisionObject> collisionObject0 = {};
+			util::TWeakSharedHandle<ICollisionObject> collisionObject1 = {};
+			std::shared_ptr<IMaterial> material0 = nullptr;
+			std::shared_ptr<IMaterial> material1 = nullptr;
+			Vector3 position = {};
+			// Impact speed or scrape speed
+			float intensity = 0.f;
+		};
+		using SoundCallback = std::function<void(const std::vector<SoundEvent> &)>;
+		PhysXContactSoundService(PhysXEnvironment &env);
+
+		void AddBody(ICollisionObject &colObj);
+		void RemoveBody(ICollisionObject &colObj);
+		bool HasBody(const ICollisionObject &colObj) const;
+		void Clear();
+
+		void SetSettings(const Settings &settings);
+		const Settings &GetSettings() const;
+
+		// Called with all sound events of a step once the step has completed
+		void SetSoundCallback(const SoundCallback &callback);
+		// Sound events of the last step
+		const std::vector<SoundEvent> &GetSoundEvents() const;
+
+		// Classifies the contact between two objects. The normal points towards colObj0.
+		void AddContact(ICollisionObject &colObj0, ICollisionObject &colObj1, PhysXMaterial *material0, PhysXMaterial *material1, float impulse, const Vector3 &position, const Vector3 &normal);
+		// Applies the rate limit and budget to the events that have been collected since the last call and delivers them
+		void DispatchEvents();
+	  private:
+		// Rate limiting state of a single body, material pair and event type
+		struct Channel {
+			const PhysXMaterial *material0 = nullptr;
+			const PhysXMaterial *material1 = nullptr;
+			EventType type = EventType::Impact;
+			double lastEventTime = std::numeric_limits<double>::lowest();
+			// Index into m_candidates, if this channel already has an event in the current step
+			int32_t candidate = -1;
+		};
+		struct Body {
+			util::TWeakSharedHandle<ICollisionObject> handle = {};
+			std::vector<Channel> channels;
+		};
+		struct Candidate {
+			// The body may be removed before the events are dispatched
+			util::TWeakSharedHandle<ICollisionObject> body = {};
+			uint32_t channel = 0;
+			util::TWeakSharedHandle<ICollisionObject> other = {};
+			PhysXMaterial *material0 = nullptr;
+			PhysXMaterial *material1 = nullptr;
+			Vector3 position = {};
+			float intensity = 0.f;
+		};
+		Body *FindBody(const ICollisionObject &colObj);
+		void AddCandidate(Body &body, EventType type, ICollisionObject &other, PhysXMaterial *material0, PhysXMaterial *material1, const Vector3 &position, float intensity);
+		PhysXEnvironment &m_env;
+		Settings m_settings {};
+		std::unordered_map<const ICollisionObject *, Body> m_bodies;
+
+		std::vector<Candidate> m_candidates;
+		std::vector<SoundEvent> m_events;
+		SoundCallback m_soundCallback = nullptr;
+	};
+};
+
+#endif
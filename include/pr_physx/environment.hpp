@@ -9,7 +9,13 @@
 #include <pragma/physics/controller.hpp>
 #include <mathutil/uvec.h>
 #include <queue>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <coroutine>
+#include <unordered_map>
 #include "pr_physx/common.hpp"
+#include "pr_physx/sim_filter_shader.hpp"
 #include <foundation/Px.h>
 
 namespace physx
@@ -48,8 +54,25 @@ namespace pragma::physics
 	class PhysXVehicle;
 	class PhysXTriangleShape;
 	class PhysXConvexHullShape;
+	class PhysXSimulationEventCallback;
 	class PhysXSimulationFilterCallback;
 	class PhysXActorShapeCollection;
+	class PhysXLineOfSightService;
+	class PhysXPoseHistory;
+	class PhysXProjectileSystem;
+	class PhysXImpactDamageService;
+	class PhysXContactSoundService;
+	class PhysXSleepStateTracker;
+	class PhysXSceneQueryLayerAdapter;
+	class PhysXSceneQueryProfiler;
+	class PhysXGameThreadExecutor;
+	class AsyncQueryAwaitable;
+	class AsyncSingleQueryAwaitable;
+	class AsyncBatchQueryAwaitable;
+	class AsyncStepAwaitable;
+	class AsyncQueryTask;
+	class PhysXAsyncQueryBatch;
+	struct PhysXAsyncState;
 	struct WheelCreateInfo;
 	struct TireCreateInfo;
 	struct ChassisCreateInfo;
@@ -59,6 +82,130 @@ namespace pragma::physics
 		: public pragma::physics::IEnvironment
 	{
 	public:
+		struct SceneQuerySettings {
+			// Pruning structures can only be changed before the scene has been created
+			physx::PxPruningStructureType::Enum staticStructure = physx::PxPruningStructureType::eDYNAMIC_AABB_TREE;
+			physx::PxPruningStructureType::Enum dynamicStructure = physx::PxPruningStructureType::eDYNAMIC_AABB_TREE;
+			physx::PxDynamicTreeSecondaryPruner::Enum dynamicTreeSecondaryPruner = physx::PxDynamicTreeSecondaryPruner::eINCREMENTAL;
+			// Number of simulation steps it takes to rebuild the dynamic tree in the background
+			uint32_t dynamicTreeRebuildRateHint = 100;
+			// By default the new trees are committed lazily by the first query after the step (PhysX default).
+			// With eBUILD_ENABLED_COMMIT_DISABLED they are committed explicitly once the step has completed instead,
+			// which keeps the commit cost out of the first query.
+			physx::PxSceneQueryUpdateMode::Enum updateMode = physx::PxSceneQueryUpdateMode::eBUILD_ENABLED_COMMIT_ENABLED;
+			// If enabled, the scene is created with eREQUIRE_RW_LOCK and scene queries may be issued from
+			// any thread while a step is in flight. They will be served from the state of the previous step.
+			// All scene reads and writes of the module (collision objects, controllers, vehicles, constraints)
+			// go through SceneReadScope/SceneWriteScope in that case.
+			// Can only be changed before the scene has been created.
+			bool queryWhileSimulating = false;
+			// If not empty, every layer gets its own pruners and queries skip the pruners of layers that are
+			// excluded by their collision mask. Objects are assigned to the first layer that overlaps their
+			// collision group, all remaining objects are put into an additional layer.
+			// Can only be changed before the scene has been created.
+			std::vector<CollisionMask> layers {};
+		};
+		// Acquires the scene read/write lock if query-while-simulating is enabled, otherwise does nothing
+		class SceneReadScope {
+		  public:
+			SceneReadScope(const PhysXEnvironment &env);
+			~SceneReadScope();
+		  private:
+			physx::PxScene *m_scene = nullptr;
+		};
+		class SceneWriteScope {
+		  public:
+			SceneWriteScope(const PhysXEnvironment &env);
+			~SceneWriteScope();
+		  private:
+			physx::PxScene *m_scene = nullptr;
+		};
+		struct SceneQueryStats {
+			// Time spent committing the scene query trees after the last step
+			std::chrono::nanoseconds lastCommitDuration {0};
+			std::chrono::nanoseconds maxCommitDuration {0};
+			// Number of times the static scene query timestamp has changed, i.e. the static pruner has been
+			// modified (static actors added, removed or moved, or a forced rebuild). This is not a measure of the tree quality.
+			uint32_t staticTreeChangeCount = 0;
+			// Number of steps since the static scene query timestamp last changed
+			uint32_t stepsSinceStaticTreeChange = 0;
+			uint32_t dynamicTreeRebuildRateHint = 0;
+			uint32_t numStaticActors = 0;
+			uint32_t numDynamicActors = 0;
+		};
+		// PhysX query flags and filter data for a fixed trace configuration, see CreateSceneQueryPreset
+		struct SceneQueryPreset {
+			physx::PxHitFlags hitFlags {};
+			physx::PxQueryFilterData queryFilterData {};
+			bool anyHit = false;
+		};
+		struct MultiHitOptions {
+			// Maximum number of hits to return, 0 means no limit. Only the closest maxHits hits are kept while the
+			// query is running, the number of hits that are collected is not limited by any buffer size.
+			uint32_t maxHits = 0;
+			// If enabled, all hits behind the closest blocking hit are discarded, which also allows
+			// PhysX to shorten the query as soon as a blocking hit has been found.
+			// Otherwise blocking hits are treated like touches and all hits are reported.
+			bool stopAtFirstBlock = true;
+		};
+		struct PenetrationHit {
+			util::TWeakSharedHandle<ICollisionObject> collisionObject = {};
+			std::shared_ptr<IShape> shape = nullptr;
+			// Material of the surface at the entry point
+			std::shared_ptr<IMaterial> material = nullptr;
+			Vector3 entryPosition = {};
+			Vector3 entryNormal = {};
+			Vector3 exitPosition = {};
+			Vector3 exitNormal = {};
+			// Distance from the trace origin to the entry point
+			float entryDistance = 0.f;
+			float thickness = 0.f;
+			// False if the trace ends inside of the geometry, or if the geometry has no back side to exit through (e.g. heightfields).
+			// In this case the exit is the end of the trace.
+			bool hasExit = true;
+		};
+		// Remembers the last occluder between an observer and each of its targets, which is tested first the next time
+		struct PerceptionCache {
+			struct Occluder {
+				// The target the entry belongs to. The address used as key may be reused by a new object once the target has been removed,
+				// so entries are only valid as long as this handle is. Entries of removed targets are pruned by the next query.
+				util::TWeakSharedHandle<ICollisionObject> target = {};
+				util::TWeakSharedHandle<ICollisionObject> collisionObject = {};
+				const physx::PxShape *shape = nullptr;
+			};
+			std::unordered_map<const ICollisionObject*,Occluder> occluders;
+		};
+		struct PerceptionQuery {
+			Vector3 eyePosition = {};
+			Vector3 eyeDirection = uvec::FORWARD;
+			// Full opening angle of the view cone
+			umath::Degree fov = 90.f;
+			float range = 1'000.f;
+			// Only objects that overlap this mask can be perceived
+			CollisionMask targetMask = CollisionMask::All;
+			// Objects that can block the line of sight to a target
+			CollisionMask occluderMask = CollisionMask::All;
+			// Collision object of the observer itself, which is ignored by all tests
+			util::TWeakSharedHandle<ICollisionObject> observer = {};
+			// Optional, has to be unique per query
+			PerceptionCache *cache = nullptr;
+		};
+		struct PerceivedTarget {
+			util::TWeakSharedHandle<ICollisionObject> collisionObject = {};
+			float distance = 0.f;
+		};
+		struct ClosestPointResult {
+			// Negative if there is no geometry within range. Points inside of a geometry have a distance of 0.
+			float distance = -1.f;
+			Vector3 closestPoint = {};
+			util::TWeakSharedHandle<ICollisionObject> collisionObject = {};
+		};
+		// Default settings for environments that are created afterwards
+		static void SetDefaultSceneQuerySettings(const SceneQuerySettings &settings);
+		static const SceneQuerySettings &GetDefaultSceneQuerySettings();
+		static void SetDefaultSimulationFilterSettings(const PhysXSimulationFilterSettings &settings);
+		static const PhysXSimulationFilterSettings &GetDefaultSimulationFilterSettings();
+
 		PhysXEnvironment(NetworkState &state);
 		static umath::Transform CreateTransform(const physx::PxTransform &pxTransform);
 		static physx::PxTransform CreatePxTransform(const umath::Transform &btTransform);
@@ -111,6 +258,8 @@ namespace pragma::physics
 		virtual util::TSharedHandle<ICollisionObject> CreateCollisionObject(IShape &shape) override;
 		virtual util::TSharedHandle<IRigidBody> CreateRigidBody(IShape &shape,bool dynamic) override;
 		virtual util::TSharedHandle<ISoftBody> CreateSoftBody(const PhysSoftBodyInfo &info,float mass,const std::vector<Vector3> &verts,const std::vector<uint16_t> &indices,std::vector<uint16_t> &indexTranslations) override;
+		// Ghost objects report overlaps with dynamic and kinematic objects only. Pairs of static objects and triggers are discarded
+		// by the filter shader, so static geometry is never reported. Triangle mesh and heightfield shapes are not supported.
 		virtual util::TSharedHandle<IGhostObject> CreateGhostObject(IShape &shape) override;
 		virtual util::TSharedHandle<ICollisionObject> CreatePlane(const Vector3 &n,float d,const IMaterial &mat) override;
 
@@ -128,17 +277,118 @@ namespace pragma::physics
 
 		physx::PxVehicleDrivableSurfaceToTireFrictionPairs &GetVehicleSurfaceTireFrictionPairs() const;
 		physx::PxScene &GetScene() const;
+		PhysXLineOfSightService &GetLineOfSightService() const;
+		// Bodies added to the pose history can be queried at earlier points in time with OverlapHistory/RayCastHistory/SweepHistory
+		PhysXPoseHistory &GetPoseHistory() const;
+		// Total time that has been simulated by this environment, in seconds
+		double GetSimulationTime() const;
+		PhysXProjectileSystem &GetProjectileSystem() const;
+		PhysXImpactDamageService &GetImpactDamageService() const;
+		PhysXContactSoundService &GetContactSoundService() const;
+		// Sleep state transitions are dispatched once per step, the awake state of all bodies is available as a bitset
+		PhysXSleepStateTracker &GetSleepStateTracker() const;
+		// Enabled between StartProfiling and EndProfiling
+		PhysXSceneQueryProfiler &GetSceneQueryProfiler() const;
+
+		void SetSceneQuerySettings(const SceneQuerySettings &settings);
+		const SceneQuerySettings &GetSceneQuerySettings() const;
+		const SceneQueryStats &GetSceneQueryStats() const;
+		// Forces a full rebuild of the scene query trees, e.g. after spawning a large number of objects
+		void RebuildSceneQueryTrees(bool rebuildStatic = true, bool rebuildDynamic = true);
+		bool IsQueryWhileSimulatingEnabled() const;
+
+		// The filter ops can only be changed before the scene has been created, existing pairs are not re-filtered
+		void SetSimulationFilterSettings(const PhysXSimulationFilterSettings &settings);
+		const PhysXSimulationFilterSettings &GetSimulationFilterSettings() const;
+		bool IsSceneQueryLayeringEnabled() const;
+		// Set in word2 of the query filter data if word0 contains a collision mask. Shapes never have this bit set, so
+		// it doesn't affect the built-in filtering, but it tells the scene query layers that they may skip pruners.
+		static constexpr physx::PxU32 QUERY_FILTER_COLLISION_MASK_FLAG = 1u << 31u;
+		// Only shapes with a collision group that overlaps the mask will pass, CollisionMask::None lets no shapes pass
+		static void ApplyQueryCollisionMask(CollisionMask mask, physx::PxQueryFilterData &queryFilterData);
+		// Returns the scene query layer objects with the specified collision group are assigned to
+		uint32_t GetSceneQueryLayer(CollisionMask group) const;
+		// True between simulate and fetchResults
+		bool IsSimulating() const;
 
 		virtual Bool Overlap(const TraceData &data,std::vector<TraceResult> *optOutResults=nullptr) const override;
 		virtual Bool RayCast(const TraceData &data,std::vector<TraceResult> *optOutResults=nullptr) const override;
 		virtual Bool Sweep(const TraceData &data,std::vector<TraceResult> *optOutResults=nullptr) const override;
 
+		// Same as RayCast/Sweep, but the results only contain actual hits (without a trailing block/none entry) and are sorted by distance.
+		// Only the hits that are returned are sorted, so a small maxHits is considerably cheaper than sorting all hits.
+		Bool RayCastSorted(const TraceData &data,std::vector<TraceResult> &outResults,const MultiHitOptions &options={}) const;
+		Bool SweepSorted(const TraceData &data,std::vector<TraceResult> &outResults,const MultiHitOptions &options={}) const;
+
+		// Translates the flags and the collision mask of the trace data once, so they don't have to be translated for every query.
+		// Filter callbacks are not part of the preset, use the regular queries if a filter is required.
+		static SceneQueryPreset CreateSceneQueryPreset(const TraceData &data);
+		// Same as RayCast/Sweep, but the flags, collision mask and filter of the trace data are ignored in favor of the preset
+		Bool RayCast(const TraceData &data,const SceneQueryPreset &preset,std::vector<TraceResult> *optOutResults=nullptr) const;
+		Bool Sweep(const TraceData &data,const SceneQueryPreset &preset,std::vector<TraceResult> *optOutResults=nullptr) const;
+
+		// Same as Overlap/RayCast/Sweep, but the query is only tested against the shapes of the specified collision objects.
+		// This bypasses the scene's pruning structures entirely and is considerably cheaper if the set of relevant objects
+		// is small and known beforehand (e.g. the hitboxes of a single character).
+		Bool OverlapTargets(const TraceData &data,const std::vector<ICollisionObject*> &targets,std::vector<TraceResult> *optOutResults=nullptr) const;
+		Bool RayCastTargets(const TraceData &data,const std::vector<ICollisionObject*> &targets,std::vector<TraceResult> *optOutResults=nullptr) const;
+		Bool SweepTargets(const TraceData &data,const std::vector<ICollisionObject*> &targets,std::vector<TraceResult> *optOutResults=nullptr) const;
+
+		// Returns every surface the ray passes through between the source and the target origin, sorted by entry distance.
+		// Blocking hits do not stop the trace, but the collision mask and filter of the trace data are still applied.
+		bool PenetrationTrace(const TraceData &data,std::vector<PenetrationHit> &outHits) const;
+		// Same as PenetrationTrace, but the traces are evaluated in parallel on the PhysX worker threads.
+		// Filter callbacks of the trace data will be called from a worker thread!
+		void PenetrationTraces(const std::vector<TraceData> &data,std::vector<std::vector<PenetrationHit>> &outHits) const;
+
+		// Same as OverlapTargets/RayCastTargets/SweepTargets, but tested against all bodies of the pose history, with the poses
+		// they had at the specified simulation time (e.g. for lag compensation). The live scene is not affected.
+		Bool OverlapHistory(const TraceData &data,double time,std::vector<TraceResult> *optOutResults=nullptr) const;
+		Bool RayCastHistory(const TraceData &data,double time,std::vector<TraceResult> *optOutResults=nullptr) const;
+		Bool SweepHistory(const TraceData &data,double time,std::vector<TraceResult> *optOutResults=nullptr) const;
+
+		// Finds all targets within the view cone of every observer that have an unobstructed line of sight to the eye.
+		// The queries are evaluated in parallel on the PhysX worker threads.
+		void QueryPerception(const std::vector<PerceptionQuery> &queries,std::vector<std::vector<PerceivedTarget>> &outResults) const;
+
+		// Finds the closest point on any sphere, capsule, box, convex or triangle mesh geometry within maxDistance of the point
+		bool FindClosestPoint(const Vector3 &point,float maxDistance,ClosestPointResult &outResult,CollisionMask mask=CollisionMask::All) const;
+		// Returns a negative value if there is no geometry within maxDistance of the point
+		float GetDistance(const Vector3 &point,float maxDistance,CollisionMask mask=CollisionMask::All) const;
+		// Same as FindClosestPoint, but the points are evaluated in parallel on the PhysX worker threads
+		void FindClosestPoints(const std::vector<Vector3> &points,float maxDistance,std::vector<ClosestPointResult> &outResults,CollisionMask mask=CollisionMask::All) const;
+
+		// Asynchronous queries are executed on the PhysX worker threads, either alongside the next simulation step
+		// or during the next call to PollAsync. Continuations are always resumed on the game thread.
+		// Filter callbacks of the trace data will be called from a worker thread!
+		AsyncSingleQueryAwaitable OverlapAsync(const TraceData &data);
+		AsyncSingleQueryAwaitable RayCastAsync(const TraceData &data);
+		AsyncSingleQueryAwaitable SweepAsync(const TraceData &data);
+		AsyncBatchQueryAwaitable OverlapBatchAsync(std::vector<TraceData> data);
+		AsyncBatchQueryAwaitable RayCastBatchAsync(std::vector<TraceData> data);
+		AsyncBatchQueryAwaitable SweepBatchAsync(std::vector<TraceData> data);
+		// Starts a simulation step without blocking. Like DoStepSimulation, the step is split into floor(timeStep /fixedTimeStep) substeps,
+		// the remaining time is not simulated. If a step is already in flight, the continuation is resumed once it has completed.
+		// The coroutine must not be destroyed while it is suspended on an asynchronous query or step.
+		AsyncStepAwaitable StepAsync(float timeStep, float fixedTimeStep = (1.f / 60.f));
+		// Has to be called regularly from the game thread if asynchronous operations are used outside of regular simulation steps.
+		// Completes the asynchronous step if it has finished, executes queued queries and resumes pending continuations.
+		void PollAsync();
+		PhysXGameThreadExecutor &GetGameThreadExecutor() const;
+
+		// Runs fn for ranges of [0,count) on the PhysX worker threads and waits for completion, see px_parallel_for
+		void ParallelFor(uint32_t count,uint32_t batchSize,const std::function<void(uint32_t,uint32_t)> &fn) const;
+
 		template<class T,typename... TARGS>
 			PhysXUniquePtr<T> CreateUniquePtr(TARGS&& ...args);
 	private:
 		friend PhysXTriangleShape;
 		friend PhysXConvexHullShape;
 		friend PhysXActorShapeCollection;
+		friend PhysXCollisionObject;
+		friend AsyncQueryAwaitable;
+		friend AsyncStepAwaitable;
+		friend AsyncQueryTask;
 
 		util::TSharedHandle<IController> CreateController(PhysXUniquePtr<physx::PxController> controller,const Vector3 &halfExtents,IController::ShapeType shapeType);
 		void InitializeShape(PhysXActorShape &shape,bool basicOnly=false) const;
@@ -146,9 +396,42 @@ namespace pragma::physics
 		void InitializeRayCastResult(const TraceData &data,float rayLength,const physx::PxRaycastHit &raycastHit,TraceResult &outResult,RayCastHitType hitType) const;
 		void InitializeRayCastResult(const TraceData &data,float rayLength,const physx::PxOverlapHit &raycastHit,TraceResult &outResult,RayCastHitType hitType) const;
 		void InitializeRayCastResult(const TraceData &data,float rayLength,const physx::PxSweepHit &raycastHit,TraceResult &outResult,RayCastHitType hitType) const;
+		struct QueryTarget {
+			const PhysXCollisionObject *object = nullptr;
+			physx::PxRigidActor *actor = nullptr;
+			// World pose to use for the actor, which doesn't have to be its current pose
+			physx::PxTransform actorPose;
+		};
+		Bool OverlapTargets(const TraceData &data,const QueryTarget *targets,size_t numTargets,std::vector<TraceResult> *optOutResults) const;
+		Bool RayCastTargets(const TraceData &data,const QueryTarget *targets,size_t numTargets,std::vector<TraceResult> *optOutResults) const;
+		Bool SweepTargets(const TraceData &data,const QueryTarget *targets,size_t numTargets,std::vector<TraceResult> *optOutResults) const;
+		std::vector<QueryTarget> GetQueryTargets(const std::vector<ICollisionObject*> &targets) const;
+		std::vector<QueryTarget> GetQueryTargets(double time) const;
+		template<bool TAnyHit>
+			Bool RayCastWithPreset(const TraceData &data,const SceneQueryPreset &preset,const physx::PxVec3 &origin,const physx::PxVec3 &unitDir,float distance,std::vector<TraceResult> *optOutResults) const;
+		template<class THit>
+			Bool InitializeSortedQueryResults(const TraceData &data,float distance,std::vector<std::pair<THit,RayCastHitType>> &hits,const MultiHitOptions &options,std::vector<TraceResult> &outResults) const;
+		template<class THit>
+			Bool InitializeQueryResults(const TraceData &data,float distance,std::vector<std::pair<THit,RayCastHitType>> &hits,std::vector<TraceResult> *optOutResults) const;
+		bool FindClosestPoint(const Vector3 &point,float maxDistance,const physx::PxQueryFilterData &queryFilterData,ClosestPointResult &outResult) const;
+		void QueryPerception(const PerceptionQuery &query,std::vector<PerceivedTarget> &outTargets) const;
 		void InitializeControllerDesc(physx::PxControllerDesc &inOutDesc,float halfHeight,float stepHeight,const umath::Transform &startTransform);
 		virtual RemainingDeltaTime DoStepSimulation(float timeStep,int maxSubSteps=1,float fixedTimeStep=(1.f /60.f)) override;
 		virtual void UpdateSurfaceTypes() override;
+		void CommitSceneQueryUpdates();
+		void UpdateContactReportFilters();
+		void QueueContactReportFilterUpdate(PhysXCollisionObject &o);
+		void BeginSubStep(float timeStep);
+		void EndSubStep(float timeStep);
+		void FinalizeStep(float timeStep);
+		void QueueAsyncQueries(PhysXAsyncQueryBatch &batch);
+		void DispatchAsyncQueries();
+		void WaitForAsyncQueries();
+		void OnAsyncQueryTaskCompleted(PhysXAsyncQueryBatch &batch);
+		void BeginAsyncStep(float timeStep, float fixedTimeStep, std::coroutine_handle<> continuation);
+		// Fetches the results of the current substep and starts the next one, or finalizes the step after the last substep
+		void AdvanceAsyncStep();
+		void CompleteAsyncStep();
 
 		PhysXUniquePtr<physx::PxScene> m_scene = px_null_ptr<physx::PxScene>();
 		PhysXUniquePtr<physx::PxControllerManager> m_controllerManager = px_null_ptr<physx::PxControllerManager>();
@@ -157,8 +440,26 @@ namespace pragma::physics
 
 		std::unique_ptr<CustomControllerBehaviorCallback> m_controllerBehaviorCallback = nullptr;
 		std::unique_ptr<CustomUserControllerHitReport> m_controllerHitReport = nullptr;
-		std::unique_ptr<physx::PxSimulationEventCallback> m_simEventCallback = nullptr;
+		std::unique_ptr<PhysXSimulationEventCallback> m_simEventCallback = nullptr;
 		std::unique_ptr<PhysXSimulationFilterCallback> m_simFilterCallback = nullptr;
+		std::unique_ptr<PhysXLineOfSightService> m_lineOfSightService = nullptr;
+		std::unique_ptr<PhysXPoseHistory> m_poseHistory = nullptr;
+		std::unique_ptr<PhysXProjectileSystem> m_projectileSystem = nullptr;
+		std::unique_ptr<PhysXImpactDamageService> m_impactDamageService = nullptr;
+		std::unique_ptr<PhysXContactSoundService> m_contactSoundService = nullptr;
+		std::unique_ptr<PhysXSleepStateTracker> m_sleepStateTracker = nullptr;
+		std::unique_ptr<PhysXSceneQueryLayerAdapter> m_sceneQueryLayerAdapter = nullptr;
+		std::unique_ptr<PhysXSceneQueryProfiler> m_sceneQueryProfiler = nullptr;
+		std::unique_ptr<PhysXAsyncState> m_asyncState = nullptr;
+		SceneQuerySettings m_sceneQuerySettings = {};
+		// Passed to the filter shader through the constant block of the scene
+		PhysXSimulationFilterSettings m_simulationFilterSettings = {};
+		SceneQueryStats m_sceneQueryStats = {};
+		uint32_t m_lastSceneQueryStaticTimestamp = 0;
+		std::atomic<bool> m_simulating {false};
+		double m_simulationTime = 0.0;
+		// Objects whose contact report filter flags have to be synchronized before the next step
+		std::vector<util::TWeakSharedHandle<ICollisionObject>> m_contactReportFilterUpdates;
 
 		NoCollisionCategoryId m_nextNoCollisionCategoryId = 1;
 		std::queue<NoCollisionCategoryId> m_freeNoCollisionCategories = {};
@@ -0,0 +1,84 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_IMPACT_DAMAGE_HPP__
+#define __PR_PX_IMPACT_DAMAGE_HPP__
+
+#include "pr_physx/common.hpp"
+#include <pragma/physics/collision_object.hpp>
+#include <mathutil/uvec.h>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace pragma::physics {
+	// Accumulates the contact impulses of registered bodies over a simulation step and turns them into
+	// at most one damage event per body and step, instead of reporting every contact point.
+	class PhysXImpactDamageService {
+	  public:
+		struct BodySettings {
+			// Impulses (or velocity changes if scaleByMass is enabled) below this value don't cause any damage
+			float threshold = 0.f;
+			// Damage per unit of impulse above the threshold
+			float damageScale = 1.f;
+			// If enabled, the impulse is divided by the mass of the body, so the damage depends on the change in velocity
+			bool scaleByMass = false;
+			uint64_t userData = 0;
+		};
+		struct DamageEvent {
+			util::TWeakSharedHandle<ICollisionObject> collisionObject = {};
+			// The body that contributed the largest impulse
+			util::TWeakSharedHandle<ICollisionObject> other = {};
+			uint64_t userData = 0;
+			// Total normal impulse that has been applied to the body during the step
+			float impulse = 0.f;
+			float damage = 0.f;
+			// Impulse-weighted average of the contact positions
+			Vector3 position = {};
+			// Impulse-weighted direction of the impulse applied to the body
+			Vector3 direction = {};
+		};
+		using DamageCallback = std::function<void(const std::vector<DamageEvent> &)>;
+		void AddBody(ICollisionObject &colObj, const BodySettings &settings = {});
+		void RemoveBody(ICollisionObject &colObj);
+		bool HasBody(const ICollisionObject &colObj) const;
+		const BodySettings *GetBodySettings(const ICollisionObject &colObj) const;
+		void Clear();
+
+		// Called with all damage events of a step once the step has completed
+		void SetDamageCallback(const DamageCallback &callback);
+		// Damage events of the last step
+		const std::vector<DamageEvent> &GetDamageEvents() const;
+
+		// Adds the total impulse of the contact points between two objects. The normal points towards colObj0.
+		void AddImpulse(ICollisionObject &colObj0, ICollisionObject &colObj1, float impulse, const Vector3 &position, const Vector3 &normal);
+		// Evaluates the impulses that have been accumulated since the last call and delivers the damage events
+		void DispatchEvents();
+	  private:
+		struct PairImpulse {
+			const ICollisionObject *other = nullptr;
+			util::TWeakSharedHandle<ICollisionObject> otherHandle = {};
+			float impulse = 0.f;
+		};
+		struct Body {
+			util::TWeakSharedHandle<ICollisionObject> handle = {};
+			BodySettings settings {};
+
+			// Accumulated during the current step
+			std::vector<PairImpulse> pairs;
+			float impulse = 0.f;
+			Vector3 weightedPosition = {};
+			Vector3 weightedDirection = {};
+		};
+		void AccumulateImpulse(const ICollisionObject &colObj, ICollisionObject &other, float impulse, const Vector3 &position, const Vector3 &direction);
+		std::unordered_map<const ICollisionObject *, Body> m_bodies;
+		// Bodies that have received an impulse during the current step
+		std::vector<const ICollisionObject *> m_activeBodies;
+
+		std::vector<DamageEvent> m_events;
+		DamageCallback m_damageCallback = nullptr;
+	};
+};
+
+#endif
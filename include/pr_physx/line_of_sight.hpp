@@ -0,0 +1,79 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_LINE_OF_SIGHT_HPP__
+#define __PR_PX_LINE_OF_SIGHT_HPP__
+
+#include <pragma/physics/collision_object.hpp>
+#include <mathutil/uvec.h>
+#include <chrono>
+#include <limits>
+#include <queue>
+#include <vector>
+#include <memory>
+
+namespace pragma::physics {
+	class PhysXEnvironment;
+	using LineOfSightPairId = uint32_t;
+
+	// Runs persistent observer -> target visibility checks with a fixed time budget per tick.
+	// Pairs are evaluated in order of priority and staleness, results are cached
+	// until the pair is evaluated again. Pairs are unregistered automatically once the observer or the target has been removed.
+	class PhysXLineOfSightService {
+	  public:
+		static constexpr LineOfSightPairId INVALID_PAIR_ID = std::numeric_limits<LineOfSightPairId>::max();
+		static constexpr std::chrono::microseconds DEFAULT_QUERY_BUDGET {500};
+		struct PairInfo {
+			util::TWeakSharedHandle<ICollisionObject> observer = {};
+			// Offsets are relative to the world transform of the respective collision object
+			Vector3 observerOffset = {};
+			util::TWeakSharedHandle<ICollisionObject> target = {};
+			Vector3 targetOffset = {};
+			// Higher priority pairs are refreshed more frequently
+			float priority = 1.f;
+			CollisionMask mask = CollisionMask::All;
+		};
+		struct Result {
+			bool visible = false;
+			// False if the pair has not been evaluated yet
+			bool valid = false;
+			uint64_t lastUpdateTick = 0;
+		};
+		PhysXLineOfSightService(PhysXEnvironment &env);
+
+		LineOfSightPairId RegisterPair(const PairInfo &info);
+		void UnregisterPair(LineOfSightPairId pairId);
+		bool IsPairValid(LineOfSightPairId pairId) const;
+		void SetPairPriority(LineOfSightPairId pairId, float priority);
+		const Result *GetResult(LineOfSightPairId pairId) const;
+		// Marks the pair as stale, so it will be re-evaluated with the highest urgency
+		void Invalidate(LineOfSightPairId pairId);
+
+		void SetQueryBudget(std::chrono::microseconds budget);
+		std::chrono::microseconds GetQueryBudget() const;
+
+		// Evaluates as many pairs as the query budget allows. Returns the number of evaluated pairs.
+		uint32_t Update();
+		uint64_t GetCurrentTick() const;
+		uint32_t GetLastUpdateQueryCount() const;
+		uint32_t GetPairCount() const;
+	  private:
+		struct Pair {
+			PairInfo info {};
+			Result result {};
+			bool active = false;
+		};
+		bool Evaluate(Pair &pair);
+		PhysXEnvironment &m_env;
+		std::vector<Pair> m_pairs = {};
+		std::queue<LineOfSightPairId> m_freePairIds = {};
+		std::vector<LineOfSightPairId> m_updateOrder = {};
+		std::chrono::microseconds m_queryBudget = DEFAULT_QUERY_BUDGET;
+		uint64_t m_tick = 0;
+		uint32_t m_numActivePairs = 0;
+		uint32_t m_lastUpdateQueryCount = 0;
+	};
+};
+
+#endif
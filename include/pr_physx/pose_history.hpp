@@ -0,0 +1,55 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_POSE_HISTORY_HPP__
+#define __PR_PX_POSE_HISTORY_HPP__
+
+#include "pr_physx/common.hpp"
+#include <pragma/physics/collision_object.hpp>
+#include <deque>
+#include <vector>
+
+namespace pragma::physics {
+	// Keeps a short history of the world poses of tracked bodies (e.g. hitboxes), which is recorded after every
+	// simulation step. Used for lag-compensated queries against the poses the bodies had at an earlier point in time.
+	class PhysXPoseHistory {
+	  public:
+		static constexpr double DEFAULT_DURATION = 1.0;
+		struct Sample {
+			// Simulation time, see PhysXEnvironment::GetSimulationTime
+			double time = 0.0;
+			physx::PxTransform pose {physx::PxIdentity};
+		};
+		struct Track {
+			util::TWeakSharedHandle<ICollisionObject> body = {};
+			// Ordered by time, oldest sample first
+			std::deque<Sample> samples;
+		};
+		PhysXPoseHistory() = default;
+		// Only rigid bodies can be tracked
+		bool AddBody(ICollisionObject &body);
+		void RemoveBody(const ICollisionObject &body);
+		bool HasBody(const ICollisionObject &body) const;
+		void Clear();
+
+		// Samples older than the duration (in seconds) are discarded
+		void SetDuration(double duration);
+		double GetDuration() const;
+
+		// Records the current pose of all tracked bodies and discards samples that are out of range
+		void Record(double time);
+		const std::vector<Track> &GetTracks() const;
+		// Interpolates between the two samples around the specified time, times outside of the recorded range are clamped.
+		// Returns false if the body is not being tracked or hasn't been recorded yet.
+		bool GetPose(const ICollisionObject &body, double time, physx::PxTransform &outPose) const;
+		static bool GetPose(const Track &track, double time, physx::PxTransform &outPose);
+	  private:
+		std::vector<Track>::iterator FindTrack(const ICollisionObject &body);
+		std::vector<Track>::const_iterator FindTrack(const ICollisionObject &body) const;
+		std::vector<Track> m_tracks;
+		double m_duration = DEFAULT_DURATION;
+	};
+};
+
+#endif
@@ -0,0 +1,121 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_PROJECTILES_HPP__
+#define __PR_PX_PROJECTILES_HPP__
+
+#include "pr_physx/common.hpp"
+#include <pragma/physics/collision_object.hpp>
+#include <pragma/physics/phys_material.hpp>
+#include <mathutil/uvec.h>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <vector>
+#include <memory>
+
+namespace pragma::physics {
+	class PhysXEnvironment;
+	using ProjectileId = uint32_t;
+
+	// Simulates large numbers of simple projectiles (bullets, arrows, grenades) without a physics actor per projectile.
+	// All projectiles are advanced every simulation substep and the swept segments are traced against the scene
+	// in parallel. Impacts are collected and delivered in a single batch after the step.
+	class PhysXProjectileSystem {
+	  public:
+		static constexpr ProjectileId INVALID_PROJECTILE_ID = std::numeric_limits<ProjectileId>::max();
+		struct CreateInfo {
+			Vector3 position = {};
+			Vector3 velocity = {};
+			// Linear drag, fraction of the velocity that is lost per second
+			float drag = 0.f;
+			float gravityScale = 1.f;
+			// If 0, the segments are traced with rays, otherwise they are swept with a sphere of this radius
+			float radius = 0.f;
+			CollisionMask mask = CollisionMask::All;
+			// The projectile is removed once its lifetime (in seconds) has expired
+			float lifetime = 10.f;
+			// If false, the projectile bounces off of the surface it hit instead of being removed
+			bool removeOnImpact = true;
+			// Fraction of the velocity along the surface normal that is kept when bouncing
+			float restitution = 0.3f;
+			// Collision object that will be ignored by the traces, usually the owner of the projectile
+			util::TWeakSharedHandle<ICollisionObject> ignore = {};
+			uint64_t userData = 0;
+		};
+		struct Impact {
+			ProjectileId projectile = INVALID_PROJECTILE_ID;
+			uint64_t userData = 0;
+			Vector3 position = {};
+			Vector3 normal = {};
+			// Velocity of the projectile at the time of impact
+			Vector3 velocity = {};
+			util::TWeakSharedHandle<ICollisionObject> collisionObject = {};
+			std::shared_ptr<IShape> shape = nullptr;
+			std::shared_ptr<IMaterial> material = nullptr;
+			// True if the projectile has been removed as a result of the impact
+			bool removed = true;
+		};
+		using ImpactCallback = std::function<void(const std::vector<Impact> &)>;
+		PhysXProjectileSystem(PhysXEnvironment &env);
+
+		ProjectileId Spawn(const CreateInfo &createInfo);
+		void Remove(ProjectileId id);
+		bool IsValid(ProjectileId id) const;
+		uint32_t GetCount() const;
+		void Clear();
+
+		Vector3 GetPosition(ProjectileId id) const;
+		Vector3 GetVelocity(ProjectileId id) const;
+		void SetVelocity(ProjectileId id, const Vector3 &velocity);
+
+		// Called with all impacts of a step once the step has completed
+		void SetImpactCallback(const ImpactCallback &callback);
+		// Impacts of the last step
+		const std::vector<Impact> &GetImpacts() const;
+
+		// Advances all projectiles by one substep and traces them against the scene
+		void Simulate(float timeStep);
+		// Delivers the impacts that have been collected since the last call
+		void DispatchImpacts();
+	  private:
+		struct StepHit {
+			const physx::PxRigidActor *actor = nullptr;
+			const physx::PxShape *shape = nullptr;
+			physx::PxVec3 position;
+			physx::PxVec3 normal;
+			uint32_t faceIndex = 0;
+			bool hit = false;
+		};
+		void SimulateRange(uint32_t start, uint32_t end, float timeStep, const physx::PxVec3 &gravity);
+		void RemoveAt(uint32_t index);
+		PhysXEnvironment &m_env;
+
+		// Structure of arrays, indexed by the dense projectile index
+		std::vector<physx::PxVec3> m_positions;
+		std::vector<physx::PxVec3> m_velocities;
+		std::vector<physx::PxVec3> m_targetPositions;
+		std::vector<float> m_drag;
+		std::vector<float> m_gravityScale;
+		std::vector<float> m_radius;
+		std::vector<float> m_lifetime;
+		std::vector<float> m_restitution;
+		std::vector<bool> m_removeOnImpact;
+		std::vector<CollisionMask> m_masks;
+		std::vector<util::TWeakSharedHandle<ICollisionObject>> m_ignore;
+		std::vector<uint64_t> m_userData;
+		std::vector<StepHit> m_stepHits;
+		std::vector<ProjectileId> m_ids;
+
+		// Projectile id -> dense index
+		std::vector<uint32_t> m_indices;
+		std::queue<ProjectileId> m_freeIds;
+
+		std::vector<Impact> m_pendingImpacts;
+		std::vector<Impact> m_impacts;
+		ImpactCallback m_impactCallback = nullptr;
+	};
+};
+
+#endif
@@ -0,0 +1,98 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_QUERY_PROFILER_HPP__
+#define __PR_PX_QUERY_PROFILER_HPP__
+
+#include <cinttypes>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace pragma::physics {
+	// Collects statistics about the scene queries issued by the environment, grouped by caller tag.
+	// Tags are assigned per thread with a TagScope, e.g.:
+	// PhysXSceneQueryProfiler::TagScope tag {"ai_cover"};
+	// env.RayCast(data);
+	class PhysXSceneQueryProfiler {
+	  public:
+		static constexpr const char *DEFAULT_TAG = "untagged";
+		enum class QueryType : uint8_t { Overlap = 0, RayCast, Sweep, Count };
+		enum class SortKey : uint8_t { TotalTime = 0, MaxTime, CallCount, TouchCount };
+		struct Stats {
+			uint64_t callCount = 0;
+			std::chrono::nanoseconds totalTime {0};
+			std::chrono::nanoseconds maxTime {0};
+			uint64_t touchCount = 0;
+			uint64_t preFilterCallCount = 0;
+			uint64_t postFilterCallCount = 0;
+			// Number of queries that filled the entire touch buffer, in which case touches may have been dropped
+			uint64_t touchBufferOverflowCount = 0;
+		};
+		struct Entry {
+			std::string tag;
+			QueryType type;
+			Stats stats;
+		};
+		// Data of the query that is currently being executed on this thread
+		struct Sample {
+			uint32_t touchCount = 0;
+			uint32_t preFilterCallCount = 0;
+			uint32_t postFilterCallCount = 0;
+			bool touchBufferOverflow = false;
+		};
+		class TagScope {
+		  public:
+			// The tag has to stay valid until the scope is destroyed
+			TagScope(const char *tag);
+			~TagScope();
+		  private:
+			const char *m_prevTag = nullptr;
+		};
+		class QueryScope {
+		  public:
+			QueryScope(PhysXSceneQueryProfiler *profiler, QueryType type);
+			~QueryScope();
+		  private:
+			PhysXSceneQueryProfiler *m_profiler = nullptr;
+			QueryType m_type;
+			Sample m_sample {};
+			Sample *m_prevSample = nullptr;
+			std::chrono::steady_clock::time_point m_tStart {};
+		};
+		static const char *GetCurrentTag();
+		// Returns nullptr if no query is being profiled on this thread
+		static Sample *GetActiveSample();
+		template<class TBuffer>
+		static void RecordTouches(const TBuffer &buffer);
+
+		void SetEnabled(bool enabled);
+		bool IsEnabled() const;
+		void Reset();
+		std::vector<Entry> GetEntries(SortKey sortKey = SortKey::TotalTime) const;
+		std::string GenerateReport(SortKey sortKey = SortKey::TotalTime) const;
+	  private:
+		void Record(QueryType type, const char *tag, const Sample &sample, std::chrono::nanoseconds duration);
+		std::atomic<bool> m_enabled {false};
+		mutable std::mutex m_statsMutex;
+		std::unordered_map<std::string, std::array<Stats, static_cast<size_t>(QueryType::Count)>> m_stats;
+	};
+};
+
+template<class TBuffer>
+void pragma::physics::PhysXSceneQueryProfiler::RecordTouches(const TBuffer &buffer)
+{
+	auto *sample = GetActiveSample();
+	if(sample == nullptr)
+		return;
+	sample->touchCount += buffer.getNbTouches();
+	if(buffer.getNbTouches() >= buffer.maxNbTouches)
+		sample->touchBufferOverflow = true;
+}
+
+#endif
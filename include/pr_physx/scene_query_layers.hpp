@@ -0,0 +1,37 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_SCENE_QUERY_LAYERS_HPP__
+#define __PR_PX_SCENE_QUERY_LAYERS_HPP__
+
+#include <PxPhysicsAPI.h>
+#include <extensions/PxCustomSceneQuerySystem.h>
+#include <pragma/physics/collision_object.hpp>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+namespace pragma::physics {
+	// Keeps a separate static and dynamic pruner for every scene query layer. Shapes are assigned to the first layer
+	// that overlaps their collision group (or an implicit last layer if there is none), and queries skip the pruners
+	// of all layers that none of the shapes within them could pass the query's collision mask for.
+	class PhysXSceneQueryLayerAdapter : public physx::PxCustomSceneQuerySystemAdapter {
+	  public:
+		PhysXSceneQueryLayerAdapter(const std::vector<CollisionMask> &layers);
+		physx::PxCustomSceneQuerySystem *CreateSceneQuerySystem(physx::PxSceneQueryUpdateMode::Enum updateMode, physx::PxPruningStructureType::Enum staticStructure, physx::PxPruningStructureType::Enum dynamicStructure,
+		  physx::PxDynamicTreeSecondaryPruner::Enum dynamicTreeSecondaryPruner) const;
+		uint32_t GetLayer(CollisionMask group) const;
+		uint32_t GetLayerCount() const;
+
+		virtual physx::PxU32 getPrunerIndex(const physx::PxRigidActor &actor, const physx::PxShape &shape) const override;
+		virtual bool processPruner(physx::PxU32 prunerIndex, const physx::PxQueryThreadContext *context, const physx::PxQueryFilterData &filterData, physx::PxQueryFilterCallback *filterCall) const override;
+	  private:
+		std::vector<CollisionMask> m_layers;
+		// Union of the collision groups of all shapes that have been assigned to each pruner. Groups are never removed,
+		// so this is conservative, but always correct.
+		std::unique_ptr<std::atomic<uint32_t>[]> m_prunerGroups = nullptr;
+	};
+};
+
+#endif
@@ -6,10 +6,24 @@
 #define __SIM_EVENT_CALLBACK_HPP__
 
 #include "common.hpp"
+#include <pragma/physics/collision_object.hpp>
+#include <pragma/physics/contact.hpp>
+#include <vector>
+#include <limits>
+#include <unordered_map>
 
 namespace pragma::physics {
+	class PhysXEnvironment;
+	class PhysXMaterial;
 	class PhysXSimulationEventCallback : public physx::PxSimulationEventCallback {
 	  public:
+		PhysXSimulationEventCallback(PhysXEnvironment &env);
+		// Contacts are only buffered while the results are being fetched and have to be dispatched
+		// with this method afterwards. The contact data is converted on the PhysX worker threads before dispatching.
+		void DispatchContacts();
+		// Trigger transitions are collected over all substeps and dispatched once per step
+		void DispatchTriggers();
+
 		/**
 		\brief This is called when a breakable constraint breaks.
 
@@ -122,6 +136,94 @@ namespace pragma::physics {
 		virtual void onAdvance(const physx::PxRigidBody *const *bodyBuffer, const physx::PxTransform *poseBuffer, const physx::PxU32 count) override;
 
 		virtual ~PhysXSimulationEventCallback() override;
+	  private:
+		// Number of contact streams converted per worker task
+		static constexpr uint32_t CONTACT_CONVERSION_BATCH_SIZE = 16;
+		// Contact data of a single step. The containers are cleared, but never shrunk, so the memory is reused for the next step.
+		struct ContactBuffer {
+			static constexpr uint32_t INVALID_SHAPE_INDEX = std::numeric_limits<uint32_t>::max();
+			struct Pair {
+				util::TWeakSharedHandle<ICollisionObject> collisionObject0 = {};
+				util::TWeakSharedHandle<ICollisionObject> collisionObject1 = {};
+				// The shapes may have been released by the callbacks of a previous pair, so they are looked up by their index
+				// in the actor shape collection of the object. The pointers are only compared, never dereferenced.
+				const physx::PxShape *shape0 = nullptr;
+				const physx::PxShape *shape1 = nullptr;
+				uint32_t shapeIndex0 = INVALID_SHAPE_INDEX;
+				uint32_t shapeIndex1 = INVALID_SHAPE_INDEX;
+				ContactInfo::Flags flags = ContactInfo::Flags::None;
+				uint32_t firstContact = 0;
+				uint32_t numContacts = 0;
+				// If true, the pair is reported to the second object of the contact points, so
+				// normals, impulses and materials have to be swapped
+				bool flipped = false;
+			};
+			std::vector<Pair> pairs;
+
+			// Contact points of a shape pair, which may be shared by two reported pairs
+			struct Stream {
+				ICollisionObject *collisionObject0 = nullptr;
+				ICollisionObject *collisionObject1 = nullptr;
+				const physx::PxShape *shape0 = nullptr;
+				const physx::PxShape *shape1 = nullptr;
+				uint32_t firstContact = 0;
+				uint32_t numContacts = 0;
+				// Forwarded to the impact damage service
+				bool reportImpacts = false;
+				// Sum of the impulses of all contact points and the impulse-weighted averages of the positions and normals
+				float totalImpulse = 0.f;
+				Vector3 position = {};
+				Vector3 normal = {};
+				// Materials of the contact point with the largest impulse
+				PhysXMaterial *material0 = nullptr;
+				PhysXMaterial *material1 = nullptr;
+			};
+			std::vector<Stream> streams;
+
+			// Raw contact points as structure of arrays, as captured during fetchResults
+			std::vector<physx::PxVec3> rawPositions;
+			std::vector<physx::PxVec3> rawNormals;
+			std::vector<float> rawImpulses;
+			std::vector<float> rawSeparations;
+			std::vector<uint32_t> faceIndices0;
+			std::vector<uint32_t> faceIndices1;
+
+			// Converted contact points
+			std::vector<Vector3> positions;
+			std::vector<Vector3> normals;
+			std::vector<Vector3> impulses;
+			std::vector<float> distances;
+			std::vector<PhysXMaterial *> materials0;
+			std::vector<PhysXMaterial *> materials1;
+			void Clear();
+		};
+		void ConvertContacts(uint32_t startStream, uint32_t endStream);
+		PhysXEnvironment &m_env;
+		ContactBuffer m_contactBuffer {};
+		// Re-used for every dispatched contact pair
+		ContactInfo m_contactInfo {};
+
+		// Trigger events are tracked per actor pair, so actors with multiple shapes only cause a single event
+		struct TriggerPair {
+			const physx::PxActor *trigger = nullptr;
+			const physx::PxActor *other = nullptr;
+			bool operator==(const TriggerPair &other) const = default;
+		};
+		struct TriggerPairHash {
+			size_t operator()(const TriggerPair &pair) const { return std::hash<const void *> {}(pair.trigger) ^ (std::hash<const void *> {}(pair.other) * 31); }
+		};
+		struct TriggerEvent {
+			util::TWeakSharedHandle<ICollisionObject> trigger = {};
+			util::TWeakSharedHandle<ICollisionObject> other = {};
+			bool startTouch = false;
+			bool cancelled = false;
+		};
+		void QueueTriggerEvent(const TriggerPair &pair, ICollisionObject &trigger, ICollisionObject &other, bool startTouch);
+		// Number of touching shape pairs per actor pair
+		std::unordered_map<TriggerPair, uint32_t, TriggerPairHash> m_triggerShapePairCounts;
+		// Index of the last event of an actor pair in m_triggerEvents for the current step
+		std::unordered_map<TriggerPair, uint32_t, TriggerPairHash> m_pendingTriggerEvents;
+		std::vector<TriggerEvent> m_triggerEvents;
 	};
 
 	class PhysXSimulationFilterCallback : public physx::PxSimulationFilterCallback {
@@ -36,14 +36,30 @@
 #include "pr_physx/common.hpp"
 #include <PxPhysXConfig.h>
 #include <PxFiltering.h>
+#include <mathutil/umath.h>
 
 class PxActor;
 
 namespace pragma::physics {
+	// Per-object filter flags are stored in the four upper bits of word2 of the simulation filter data.
+	// These bits are ignored by the groups mask logic.
+	enum class PhysXSimulationFilterFlags : uint32_t {
+		None = 0u,
+		// The object is a ghost object, which also reports kinematic objects that overlap it
+		GhostObject = 1u << 28u,
+		// Contacts are also reported while the objects stay in contact, not only when touching starts or ends
+		ReportPersistentContacts = GhostObject << 1u,
+		ReportContacts = ReportPersistentContacts << 1u,
+		// Contacts are only reported once the contact force exceeds the contact report threshold of the actor
+		ThresholdForce = ReportContacts << 1u,
+
+		ContactReportMask = ReportPersistentContacts | ReportContacts | ThresholdForce,
+		Mask = GhostObject | ContactReportMask
+	};
+
 	class PhysXGroupsMask {
 	  public:
 		PX_INLINE PhysXGroupsMask() : bits0(0), bits1(0), bits2(0), bits3(0) {}
-		PX_INLINE ~PhysXGroupsMask() {}
 
 		physx::PxU16 bits0, bits1, bits2, bits3;
 	};
@@ -57,13 +73,28 @@ namespace pragma::physics {
 		enum Enum { PX_FILTEROP_AND, PX_FILTEROP_OR, PX_FILTEROP_XOR, PX_FILTEROP_NAND, PX_FILTEROP_NOR, PX_FILTEROP_NXOR, PX_FILTEROP_SWAP_AND };
 	};
 
+	/**
+	\brief Filter state of a scene. See comments for PxGroupsMask
+
+	The settings are copied into the constant block of the scene, so every environment has its own filter state.
+	The filter operations are compiled into the filter shader and can only be changed before the scene has been created.
+
+	@see PhysXGetSimulationFilterShader
+	*/
+	struct PhysXSimulationFilterSettings {
+		PhysXFilterOp::Enum filterOps[3] = {PhysXFilterOp::PX_FILTEROP_AND, PhysXFilterOp::PX_FILTEROP_AND, PhysXFilterOp::PX_FILTEROP_AND};
+		PhysXGroupsMask filterConstants[2] = {};
+		bool filterBool = false;
+	};
+
 	/**
 	\brief Implementation of a simple filter shader that emulates PhysX 2.8.x filtering
 
 	This shader provides the following logic:
-	\li If one of the two filter objects is a trigger, the pair is acccepted and #PxPairFlag::eTRIGGER_DEFAULT will be used for trigger reports
+	\li If one of the two filter objects is a trigger, the pair is killed if the other object is static or kinematic (unless the trigger is a ghost object), otherwise it is acccepted and #PxPairFlag::eTRIGGER_DEFAULT will be used for trigger reports
 	\li Else, if the filter mask logic (see further below) discards the pair it will be suppressed (#PxFilterFlag::eSUPPRESS)
 	\li Else, the pair gets accepted and collision response gets enabled (#PxPairFlag::eCONTACT_DEFAULT)
+	\li Touch found/lost notifications are always requested to maintain the touching sets, contact points are only requested if at least one of the two objects has subscribed to contact reports (see #PhysXSimulationFilterFlags)
 
 	Filter mask logic:
 	Given the two #PxFilterData structures fd0 and fd1 of two collision objects, the pair passes the filter if the following
@@ -72,11 +103,12 @@ namespace pragma::physics {
 		1) Collision groups of the pair are enabled
 		2) Collision filtering equation is satisfied
 
+	The filter shader is specialized for the filter operations of the settings, the constants and the boolean value are read
+	from the constant block of the scene, which has to contain the #PhysXSimulationFilterSettings.
+
 	@see PxSimulationFilterShader
 	*/
-
-	physx::PxFilterFlags PhysXSimulationFilterShader(physx::PxFilterObjectAttributes attributes0, physx::PxFilterData filterData0, physx::PxFilterObjectAttributes attributes1, physx::PxFilterData filterData1, physx::PxPairFlags &pairFlags, const void *constantBlock,
-	  physx::PxU32 constantBlockSize);
+	physx::PxSimulationFilterShader PhysXGetSimulationFilterShader(const PhysXSimulationFilterSettings &settings);
 
 	/**
 		\brief Determines if collision detection is performed between a pair of groups
@@ -130,66 +162,6 @@ namespace pragma::physics {
 	*/
 	void PhysXSetGroup(physx::PxActor &actor, const physx::PxU16 collisionGroup);
 
-	/**
-	\brief Retrieves filtering operation. See comments for PxGroupsMask
-
-	\param[out] op0 First filter operator.
-	\param[out] op1 Second filter operator.
-	\param[out] op2 Third filter operator.
-
-	@see PxSetFilterOps PxSetFilterBool PxSetFilterConstants
-	*/
-	void PhysXGetFilterOps(PhysXFilterOp::Enum &op0, PhysXFilterOp::Enum &op1, PhysXFilterOp::Enum &op2);
-
-	/**
-	\brief Setups filtering operations. See comments for PxGroupsMask
-
-	\param[in] op0 Filter op 0.
-	\param[in] op1 Filter op 1.
-	\param[in] op2 Filter op 2.
-
-	@see PxSetFilterBool PxSetFilterConstants
-	*/
-	void PhysXSetFilterOps(const PhysXFilterOp::Enum &op0, const PhysXFilterOp::Enum &op1, const PhysXFilterOp::Enum &op2);
-
-	/**
-	\brief Retrieves filtering's boolean value. See comments for PxGroupsMask
-
-	\return flag Boolean value for filter.
-
-	@see PxSetFilterBool PxSetFilterConstants
-	*/
-	bool PhysXGetFilterBool();
-
-	/**
-	\brief Setups filtering's boolean value. See comments for PxGroupsMask
-
-	\param[in] enable Boolean value for filter.
-
-	@see PxSetFilterOps PxSsetFilterConstants
-	*/
-	void PhysXSetFilterBool(const bool enable);
-
-	/**
-	\brief Gets filtering constant K0 and K1. See comments for PxGroupsMask
-
-	\param[out] c0 the filtering constants, as a mask. See #PxGroupsMask.
-	\param[out] c1 the filtering constants, as a mask. See #PxGroupsMask.
-
-	@see PxSetFilterOps PxSetFilterBool PxSetFilterConstants
-	*/
-	void PhysXGetFilterConstants(PhysXGroupsMask &c0, PhysXGroupsMask &c1);
-
-	/**
-	\brief Setups filtering's K0 and K1 value. See comments for PxGroupsMask
-
-	\param[in] c0 The new group mask. See #PxGroupsMask.
-	\param[in] c1 The new group mask. See #PxGroupsMask.
-
-	@see PxSetFilterOps PxSetFilterBool PxGetFilterConstants
-	*/
-	void PhysXSetFilterConstants(const PhysXGroupsMask &c0, const PhysXGroupsMask &c1);
-
 	/**
 	\brief Gets 64-bit mask used for collision filtering. See comments for PxGroupsMask
 
@@ -212,4 +184,6 @@ namespace pragma::physics {
 	void PhysXSetGroupsMask(physx::PxActor &actor, const PhysXGroupsMask &mask);
 };
 
+REGISTER_BASIC_BITWISE_OPERATORS(pragma::physics::PhysXSimulationFilterFlags)
+
 #endif
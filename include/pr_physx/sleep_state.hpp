@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_SLEEP_STATE_HPP__
+#define __PR_PX_SLEEP_STATE_HPP__
+
+#include "pr_physx/common.hpp"
+#include <pragma/physics/collision_object.hpp>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace pragma::physics {
+	// Records the sleep state transitions of a step and keeps a dense awake bitset indexed by body id.
+	// Systems that are interested in the sleep state of many bodies (e.g. network relevance) can scan the bitset,
+	// instead of subscribing to every single body. Only bodies with sleep reports enabled are tracked.
+	class PhysXSleepStateTracker {
+	  public:
+		using BodyId = uint32_t;
+		static constexpr BodyId INVALID_BODY_ID = std::numeric_limits<BodyId>::max();
+		struct Transition {
+			util::TWeakSharedHandle<ICollisionObject> collisionObject = {};
+			BodyId bodyId = INVALID_BODY_ID;
+			bool awake = false;
+		};
+		using TransitionCallback = std::function<void(const std::vector<Transition> &)>;
+
+		// Ids of removed bodies are re-used, so the bitset stays dense
+		BodyId AllocateBodyId();
+		void ReleaseBodyId(BodyId id);
+		// Upper bound of all body ids that are currently in use
+		uint32_t GetBodyIdCount() const;
+
+		bool IsAwake(BodyId id) const;
+		void SetAwake(BodyId id, bool awake);
+		// Bit i of word i /64 is set if body i is awake
+		const std::vector<uint64_t> &GetAwakeBits() const;
+		uint32_t GetAwakeBodyCount() const;
+
+		// Called from within fetchResults, the state is updated immediately, but the bodies are only notified in DispatchTransitions
+		void RecordTransition(ICollisionObject &colObj, BodyId id, bool awake);
+		// Called with all transitions of a step once the step has completed
+		void SetTransitionCallback(const TransitionCallback &callback);
+		// Transitions of the last step
+		const std::vector<Transition> &GetTransitions() const;
+		// Notifies all bodies whose sleep state has changed since the last call and delivers the transitions
+		void DispatchTransitions();
+	  private:
+		std::vector<uint64_t> m_awakeBits;
+		BodyId m_nextBodyId = 0;
+		std::vector<BodyId> m_freeBodyIds;
+
+		std::vector<Transition> m_pendingTransitions;
+		std::vector<Transition> m_transitions;
+		TransitionCallback m_transitionCallback = nullptr;
+	};
+};
+
+#endif
@@ -0,0 +1,20 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __PR_PX_TASK_HPP__
+#define __PR_PX_TASK_HPP__
+
+#include <cinttypes>
+#include <functional>
+
+namespace physx {
+	class PxCpuDispatcher;
+};
+namespace pragma::physics {
+	// Splits [0,count) into ranges of at most batchSize indices and runs fn for each range on the worker threads of the dispatcher.
+	// The calling thread processes the first range itself and blocks until all ranges have been completed.
+	void px_parallel_for(physx::PxCpuDispatcher &dispatcher, uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)> &fn);
+};
+
+#endif
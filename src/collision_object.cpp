@@ -9,6 +9,7 @@
 #include "pr_physx/controller.hpp"
 #include <extensions/PxRigidBodyExt.h>
 #include <pragma/util/util_game.hpp>
+#include <algorithm>
 
 pragma::physics::PhysXCollisionObject &pragma::physics::PhysXCollisionObject::GetCollisionObject(ICollisionObject &o) { return *static_cast<PhysXCollisionObject *>(o.GetUserData()); }
 const pragma::physics::PhysXCollisionObject &pragma::physics::PhysXCollisionObject::GetCollisionObject(const ICollisionObject &o) { return GetCollisionObject(const_cast<ICollisionObject &>(o)); }
@@ -17,29 +18,142 @@ void pragma::physics::PhysXCollisionObject::Initialize()
 {
 	ICollisionObject::Initialize();
 	GetInternalObject().userData = this;
+	m_bodyId = GetPxEnv().GetSleepStateTracker().AllocateBodyId();
 }
 void pragma::physics::PhysXCollisionObject::OnRemove()
 {
 	ApplyCollisionShape(nullptr);
+	if(m_bodyId != PhysXSleepStateTracker::INVALID_BODY_ID) {
+		GetPxEnv().GetSleepStateTracker().ReleaseBodyId(m_bodyId);
+		m_bodyId = PhysXSleepStateTracker::INVALID_BODY_ID;
+	}
 	ICollisionObject::OnRemove();
 }
 physx::PxActor &pragma::physics::PhysXCollisionObject::GetInternalObject() const { return *m_actor; }
+bool pragma::physics::PhysXCollisionObject::HasInternalObject() const { return m_actor != nullptr; }
 pragma::physics::PhysXEnvironment &pragma::physics::PhysXCollisionObject::GetPxEnv() const { return static_cast<PhysXEnvironment &>(m_physEnv); }
 void pragma::physics::PhysXCollisionObject::GetAABB(Vector3 &min, Vector3 &max) const
 {
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
 	auto bounds = m_actor->getWorldBounds();
 	min = GetPxEnv().FromPhysXVector(bounds.minimum);
 	max = GetPxEnv().FromPhysXVector(bounds.maximum);
 }
-void pragma::physics::PhysXCollisionObject::SetSleepReportEnabled(bool reportEnabled) { m_actor->setActorFlag(physx::PxActorFlag::eSEND_SLEEP_NOTIFIES, reportEnabled); }
-bool pragma::physics::PhysXCollisionObject::IsSleepReportEnabled() const { return m_actor->getActorFlags().isSet(physx::PxActorFlag::eSEND_SLEEP_NOTIFIES); }
+void pragma::physics::PhysXCollisionObject::SetSleepReportEnabled(bool reportEnabled)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	m_actor->setActorFlag(physx::PxActorFlag::eSEND_SLEEP_NOTIFIES, reportEnabled);
+}
+bool pragma::physics::PhysXCollisionObject::IsSleepReportEnabled() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return m_actor->getActorFlags().isSet(physx::PxActorFlag::eSEND_SLEEP_NOTIFIES);
+}
+void pragma::physics::PhysXCollisionObject::SetContactReportEnabled(bool reportEnabled)
+{
+	ICollisionObject::SetContactReportEnabled(reportEnabled);
+	MarkContactReportFilterDirty();
+}
 
 void pragma::physics::PhysXCollisionObject::SetTrigger(bool bTrigger) { m_actorShapeCollection.SetTrigger(bTrigger); }
 bool pragma::physics::PhysXCollisionObject::IsTrigger() const { return m_actorShapeCollection.IsTrigger(); }
 
 void pragma::physics::PhysXCollisionObject::TransformLocalPose(const umath::Transform &t) { m_actorShapeCollection.TransformLocalPose(t); }
+
+void pragma::physics::PhysXCollisionObject::UpdateContactReportFilterFlags()
+{
+	m_contactReportFilterDirty = false;
+	if(m_actor == nullptr)
+		return; // Removed from the world
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	auto flags = PhysXSimulationFilterFlags::None;
+	if(IsContactReportEnabled() || IsImpactReportEnabled()) {
+		flags |= PhysXSimulationFilterFlags::ReportContacts;
+		// Native systems like the contact sound service have to know about sliding contacts as well
+		if(IsImpactReportEnabled())
+			flags |= PhysXSimulationFilterFlags::ReportPersistentContacts;
+		auto *rigidBody = m_actor->is<physx::PxRigidBody>();
+		if(rigidBody && rigidBody->getContactReportThreshold() < PX_MAX_F32)
+			flags |= PhysXSimulationFilterFlags::ThresholdForce;
+	}
+	if(flags == m_contactReportFilterFlags)
+		return;
+	m_contactReportFilterFlags = flags;
+	ApplyContactReportFilterFlags();
+}
+void pragma::physics::PhysXCollisionObject::MarkContactReportFilterDirty()
+{
+	if(m_contactReportFilterDirty)
+		return;
+	m_contactReportFilterDirty = true;
+	GetPxEnv().QueueContactReportFilterUpdate(*this);
+}
+void pragma::physics::PhysXCollisionObject::AddImpactReportListener()
+{
+	++m_impactReportListenerCount;
+	MarkContactReportFilterDirty();
+}
+void pragma::physics::PhysXCollisionObject::RemoveImpactReportListener()
+{
+	if(m_impactReportListenerCount == 0)
+		return;
+	--m_impactReportListenerCount;
+	MarkContactReportFilterDirty();
+}
+bool pragma::physics::PhysXCollisionObject::IsImpactReportEnabled() const { return m_impactReportListenerCount > 0; }
+const pragma::physics::PhysXCollisionObject::TouchingSet &pragma::physics::PhysXCollisionObject::GetTouchingObjects() const { return m_touchingObjects; }
+uint32_t pragma::physics::PhysXCollisionObject::GetTouchingObjectCount() const { return m_touchingObjects.size(); }
+bool pragma::physics::PhysXCollisionObject::IsTouching(const ICollisionObject &other) const
+{
+	for(auto &touchingObject : m_touchingObjects) {
+		if(touchingObject.object == &other)
+			return true;
+	}
+	return false;
+}
+void pragma::physics::PhysXCollisionObject::AddTouchingObject(ICollisionObject &other)
+{
+	if(IsTouching(other))
+		return;
+	m_touchingObjects.pushBack({&other, util::weak_shared_handle_cast<IBase, ICollisionObject>(other.GetHandle())});
+}
+void pragma::physics::PhysXCollisionObject::RemoveTouchingObject(const ICollisionObject &other)
+{
+	for(auto i = decltype(m_touchingObjects.size()) {0u}; i < m_touchingObjects.size(); ++i) {
+		if(m_touchingObjects[i].object != &other)
+			continue;
+		m_touchingObjects.replaceWithLast(i);
+		return;
+	}
+}
+void pragma::physics::PhysXCollisionObject::ClearTouchingObjects()
+{
+	// No lost touch is reported for objects that are removed from the scene, so the other side has to be updated here
+	for(auto &touchingObject : m_touchingObjects) {
+		auto *other = touchingObject.handle.Get();
+		if(other)
+			GetCollisionObject(*other).RemoveTouchingObject(*this);
+	}
+	m_touchingObjects.clear();
+}
+
+void pragma::physics::PhysXCollisionObject::ApplyContactReportFilterFlags()
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	for(auto &actorShape : m_actorShapeCollection.GetActorShapes()) {
+		auto &pxActorShape = actorShape->GetActorShape();
+		auto simFilterData = pxActorShape.getSimulationFilterData();
+		simFilterData.word2 = (simFilterData.word2 & ~umath::to_integral(PhysXSimulationFilterFlags::ContactReportMask)) | umath::to_integral(m_contactReportFilterFlags);
+		pxActorShape.setSimulationFilterData(simFilterData);
+	}
+	// Existing pairs keep the pair flags they were created with
+	auto *scene = m_actor->getScene();
+	if(scene)
+		scene->resetFiltering(*m_actor);
+}
 pragma::physics::NoCollisionCategoryId pragma::physics::PhysXCollisionObject::DisableSelfCollisions()
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(m_noCollisionCategory == nullptr)
 		m_noCollisionCategory = GetPxEnv().GetUniqueNoCollisionCategory();
 	for(auto &actorShape : m_actorShapeCollection.GetActorShapes()) {
@@ -56,16 +170,112 @@ pragma::physics::NoCollisionCategoryId pragma::physics::PhysXCollisionObject::Di
 	return *m_noCollisionCategory;
 }
 pragma::physics::PhysXActorShapeCollection &pragma::physics::PhysXCollisionObject::GetActorShapeCollection() const { return m_actorShapeCollection; }
+pragma::physics::PhysXSleepStateTracker::BodyId pragma::physics::PhysXCollisionObject::GetBodyId() const { return m_bodyId; }
 void pragma::physics::PhysXCollisionObject::RemoveWorldObject()
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(m_actor == nullptr || IsSpawned() == false)
 		return;
 	if(IsAwake())
 		OnSleep();
+	GetPxEnv().GetSleepStateTracker().SetAwake(m_bodyId, false);
+	ClearTouchingObjects();
 	GetPxEnv().GetScene().removeActor(*m_actor);
 	m_actor = nullptr;
 }
-void pragma::physics::PhysXCollisionObject::DoAddWorldObject() { GetPxEnv().GetScene().addActor(*m_actor); }
+void pragma::physics::PhysXCollisionObject::DoAddWorldObject()
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetPxEnv().GetScene().addActor(*m_actor);
+}
+
+void pragma::physics::PhysXCollisionObject::AttachCollisionShape(pragma::physics::IShape *optShape)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	auto &o = static_cast<physx::PxRigidActor &>(*m_actor);
+	// Clear all current shapes
+	auto numShapes = o.getNbShapes();
+	std::vector<physx::PxShape *> shapes {numShapes};
+	numShapes = o.getShapes(shapes.data(), numShapes);
+	for(auto i = decltype(numShapes) {0u}; i < numShapes; ++i) {
+		auto *pShape = shapes.at(i);
+		o.detachShape(*pShape);
+	}
+	//
+	m_actorShapeCollection.Clear();
+	ClearTouchingObjects();
+	if(optShape == nullptr || o.getNbShapes() > 0)
+		return;
+	if(optShape->IsCompoundShape() == false) {
+		auto *mat = PhysXShape::GetShape(*optShape).GetMaterial();
+		if(mat == nullptr)
+			mat = &GetPxEnv().GetGenericMaterial();
+		m_actorShapeCollection.AttachShapeToActor(PhysXShape::GetShape(*optShape), PhysXMaterial::GetMaterial(*mat));
+	}
+	else {
+		auto &compoundShape = static_cast<PhysXCompoundShape &>(PhysXShape::GetShape(*optShape));
+		auto &subShapes = compoundShape.GetShapes();
+		std::vector<physx::PxShape *> pxShapes {};
+		pxShapes.reserve(subShapes.size());
+		auto parentPose = compoundShape.GetLocalPose();
+		for(auto i = decltype(subShapes.size()) {0u}; i < subShapes.size(); ++i) {
+			auto &shapeInfo = subShapes.at(i);
+			if(shapeInfo.shape->IsCompoundShape() == true)
+				continue; // Compound shapes of compound shapes currently not supported
+			auto *mat = PhysXShape::GetShape(*shapeInfo.shape).GetMaterial();
+			if(mat == nullptr) {
+				mat = compoundShape.GetMaterial();
+				if(mat == nullptr)
+					mat = &GetPxEnv().GetGenericMaterial();
+			}
+			m_actorShapeCollection.AttachShapeToActor(PhysXShape::GetShape(*shapeInfo.shape), PhysXMaterial::GetMaterial(*mat), parentPose * shapeInfo.localPose);
+		}
+	}
+
+	// We need to re-apply our collision group and mask
+	SetCollisionFilterGroup(GetCollisionFilterGroup());
+	SetCollisionFilterMask(GetCollisionFilterMask());
+	if(m_noCollisionCategory)
+		DisableSelfCollisions();
+	ApplyContactReportFilterFlags();
+}
+void pragma::physics::PhysXCollisionObject::ApplyCollisionFilterGroup(CollisionMask group)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	for(auto &actorShape : GetActorShapeCollection().GetActorShapes()) {
+		auto &pxActorShape = actorShape->GetActorShape();
+
+		auto queryFilterData = pxActorShape.getQueryFilterData();
+		auto prevGroup = queryFilterData.word0;
+		queryFilterData.word0 = umath::to_integral(group);
+		pxActorShape.setQueryFilterData(queryFilterData);
+		// With scene query layers the pruner of a shape depends on its collision group,
+		// so it has to be re-inserted into the scene query system
+		if(prevGroup != queryFilterData.word0 && GetPxEnv().IsSceneQueryLayeringEnabled() && pxActorShape.getFlags().isSet(physx::PxShapeFlag::eSCENE_QUERY_SHAPE)) {
+			pxActorShape.setFlag(physx::PxShapeFlag::eSCENE_QUERY_SHAPE, false);
+			pxActorShape.setFlag(physx::PxShapeFlag::eSCENE_QUERY_SHAPE, true);
+		}
+
+		auto simFilterData = pxActorShape.getSimulationFilterData();
+		simFilterData.word0 = umath::to_integral(group);
+		pxActorShape.setSimulationFilterData(simFilterData);
+	}
+}
+void pragma::physics::PhysXCollisionObject::ApplyCollisionFilterMask(CollisionMask mask)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	for(auto &actorShape : GetActorShapeCollection().GetActorShapes()) {
+		auto &pxActorShape = actorShape->GetActorShape();
+
+		auto queryFilterData = pxActorShape.getQueryFilterData();
+		queryFilterData.word1 = umath::to_integral(mask);
+		pxActorShape.setQueryFilterData(queryFilterData);
+
+		auto simFilterData = pxActorShape.getSimulationFilterData();
+		simFilterData.word1 = umath::to_integral(mask);
+		pxActorShape.setSimulationFilterData(simFilterData);
+	}
+}
 
 //////////////////
 
@@ -76,15 +286,35 @@ void pragma::physics::PhysXRigidBody::SetContactProcessingThreshold(float thresh
 {
 	// GetInternalObject().setContactReportThreshold();
 }
+void pragma::physics::PhysXRigidBody::SetContactReportForceThreshold(float threshold)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	auto *rigidBody = GetInternalObject().is<physx::PxRigidBody>();
+	if(rigidBody == nullptr)
+		return;
+	rigidBody->setContactReportThreshold((threshold > 0.f) ? threshold : PX_MAX_F32);
+	MarkContactReportFilterDirty();
+}
+float pragma::physics::PhysXRigidBody::GetContactReportForceThreshold() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	auto *rigidBody = GetInternalObject().is<physx::PxRigidBody>();
+	if(rigidBody == nullptr)
+		return 0.f;
+	auto threshold = rigidBody->getContactReportThreshold();
+	return (threshold < PX_MAX_F32) ? threshold : 0.f;
+}
 Vector3 pragma::physics::PhysXRigidBody::GetPos() const
 {
 	auto *pController = GetController();
 	if(pController)
 		return pController->GetPos();
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
 	return GetPxEnv().FromPhysXVector(GetInternalObject().getGlobalPose().p);
 }
 void pragma::physics::PhysXRigidBody::SetPos(const Vector3 &pos)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto *pController = GetController();
 	if(pController) {
 		// If this rigid body belongs to a controller, we mustn't
@@ -104,10 +334,12 @@ Quat pragma::physics::PhysXRigidBody::GetRotation() const
 		// Controller has no rotation
 		return uquat::identity();
 	}
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
 	return GetPxEnv().FromPhysXRotation(GetInternalObject().getGlobalPose().q);
 }
 void pragma::physics::PhysXRigidBody::SetRotation(const Quat &rot)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto *pController = GetController();
 	if(pController) {
 		// Controller mustn't be rotated
@@ -119,11 +351,13 @@ void pragma::physics::PhysXRigidBody::SetRotation(const Quat &rot)
 }
 umath::Transform pragma::physics::PhysXRigidBody::GetWorldTransform()
 {
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
 	auto t = GetInternalObject().getGlobalPose();
 	return GetPxEnv().CreateTransform(t);
 }
 void pragma::physics::PhysXRigidBody::SetWorldTransform(const umath::Transform &t)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto *pController = GetController();
 	if(pController) {
 		// Only the position of the transform
@@ -135,8 +369,16 @@ void pragma::physics::PhysXRigidBody::SetWorldTransform(const umath::Transform &
 	GetInternalObject().setGlobalPose(pxPose);
 }
 
-void pragma::physics::PhysXRigidBody::SetSimulationEnabled(bool b) { GetInternalObject().setActorFlag(physx::PxActorFlag::eDISABLE_SIMULATION, !b); }
-bool pragma::physics::PhysXRigidBody::IsSimulationEnabled() const { return GetInternalObject().getActorFlags().isSet(physx::PxActorFlag::eDISABLE_SIMULATION); }
+void pragma::physics::PhysXRigidBody::SetSimulationEnabled(bool b)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setActorFlag(physx::PxActorFlag::eDISABLE_SIMULATION, !b);
+}
+bool pragma::physics::PhysXRigidBody::IsSimulationEnabled() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getActorFlags().isSet(physx::PxActorFlag::eDISABLE_SIMULATION);
+}
 void pragma::physics::PhysXRigidBody::SetCollisionsEnabled(bool enabled)
 {
 	// TODO
@@ -158,81 +400,20 @@ void pragma::physics::PhysXRigidBody::ApplyCollisionShape(pragma::physics::IShap
 {
 	if(m_controller.GetRawPtr())
 		return; // If this is a controller, we mustn't detach or attach any shapes
-	auto &o = GetInternalObject();
-	// Clear all current shapes
-	auto numShapes = o.getNbShapes();
-	std::vector<physx::PxShape *> shapes {numShapes};
-	numShapes = o.getShapes(shapes.data(), numShapes);
-	for(auto i = decltype(numShapes) {0u}; i < numShapes; ++i) {
-		auto *pShape = shapes.at(i);
-		o.detachShape(*pShape);
-	}
-	//
-	m_actorShapeCollection.Clear();
-	if(optShape == nullptr || o.getNbShapes() > 0)
-		return;
-	if(optShape->IsCompoundShape() == false) {
-		auto *mat = PhysXShape::GetShape(*optShape).GetMaterial();
-		if(mat == nullptr)
-			mat = &GetPxEnv().GetGenericMaterial();
-		m_actorShapeCollection.AttachShapeToActor(PhysXShape::GetShape(*optShape), PhysXMaterial::GetMaterial(*mat));
-	}
-	else {
-		auto &compoundShape = static_cast<PhysXCompoundShape &>(PhysXShape::GetShape(*optShape));
-		auto &subShapes = compoundShape.GetShapes();
-		std::vector<physx::PxShape *> pxShapes {};
-		pxShapes.reserve(subShapes.size());
-		auto parentPose = compoundShape.GetLocalPose();
-		for(auto i = decltype(subShapes.size()) {0u}; i < subShapes.size(); ++i) {
-			auto &shapeInfo = subShapes.at(i);
-			if(shapeInfo.shape->IsCompoundShape() == true)
-				continue; // Compound shapes of compound shapes currently not supported
-			auto *mat = PhysXShape::GetShape(*shapeInfo.shape).GetMaterial();
-			if(mat == nullptr) {
-				mat = compoundShape.GetMaterial();
-				if(mat == nullptr)
-					mat = &GetPxEnv().GetGenericMaterial();
-			}
-			m_actorShapeCollection.AttachShapeToActor(PhysXShape::GetShape(*shapeInfo.shape), PhysXMaterial::GetMaterial(*mat), parentPose * shapeInfo.localPose);
-		}
-	}
-
-	// We need to re-apply our collision group and mask
-	SetCollisionFilterGroup(GetCollisionFilterGroup());
-	SetCollisionFilterMask(GetCollisionFilterMask());
-	if(m_noCollisionCategory)
-		DisableSelfCollisions();
+	AttachCollisionShape(optShape);
 }
-void pragma::physics::PhysXRigidBody::DoSetCollisionFilterGroup(CollisionMask group)
+void pragma::physics::PhysXRigidBody::DoSetCollisionFilterGroup(CollisionMask group) { ApplyCollisionFilterGroup(group); }
+void pragma::physics::PhysXRigidBody::DoSetCollisionFilterMask(CollisionMask mask) { ApplyCollisionFilterMask(mask); }
+umath::Transform pragma::physics::PhysXRigidBody::GetBaseTransform()
 {
-	for(auto &actorShape : GetActorShapeCollection().GetActorShapes()) {
-		auto &pxActorShape = actorShape->GetActorShape();
-
-		auto queryFilterData = pxActorShape.getQueryFilterData();
-		queryFilterData.word0 = umath::to_integral(group);
-		pxActorShape.setQueryFilterData(queryFilterData);
-
-		auto simFilterData = pxActorShape.getSimulationFilterData();
-		simFilterData.word0 = umath::to_integral(group);
-		pxActorShape.setSimulationFilterData(simFilterData);
-	}
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetPxEnv().CreateTransform(GetInternalObject().getGlobalPose());
 }
-void pragma::physics::PhysXRigidBody::DoSetCollisionFilterMask(CollisionMask mask)
+void pragma::physics::PhysXRigidBody::SetBaseTransform(const umath::Transform &t)
 {
-	for(auto &actorShape : GetActorShapeCollection().GetActorShapes()) {
-		auto &pxActorShape = actorShape->GetActorShape();
-
-		auto queryFilterData = pxActorShape.getQueryFilterData();
-		queryFilterData.word1 = umath::to_integral(mask);
-		pxActorShape.setQueryFilterData(queryFilterData);
-
-		auto simFilterData = pxActorShape.getSimulationFilterData();
-		simFilterData.word1 = umath::to_integral(mask);
-		pxActorShape.setSimulationFilterData(simFilterData);
-	}
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setGlobalPose(GetPxEnv().CreatePxTransform(t));
 }
-umath::Transform pragma::physics::PhysXRigidBody::GetBaseTransform() { return GetPxEnv().CreateTransform(GetInternalObject().getGlobalPose()); }
-void pragma::physics::PhysXRigidBody::SetBaseTransform(const umath::Transform &t) { GetInternalObject().setGlobalPose(GetPxEnv().CreatePxTransform(t)); }
 void pragma::physics::PhysXRigidBody::SetCenterOfMassOffset(const Vector3 &offset)
 {
 	// TODO
@@ -255,6 +436,7 @@ pragma::physics::PhysXRigidDynamic::PhysXRigidDynamic(IEnvironment &env, PhysXUn
 physx::PxRigidDynamic &pragma::physics::PhysXRigidDynamic::GetInternalObject() const { return static_cast<physx::PxRigidDynamic &>(PhysXRigidBody::GetInternalObject()); }
 void pragma::physics::PhysXRigidDynamic::SetActivationState(ActivationState state)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	switch(state) {
 	case ActivationState::Asleep:
 	case ActivationState::WaitForDeactivation:
@@ -270,6 +452,7 @@ void pragma::physics::PhysXRigidDynamic::SetActivationState(ActivationState stat
 }
 pragma::physics::ICollisionObject::ActivationState pragma::physics::PhysXRigidDynamic::GetActivationState() const
 {
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
 	if(GetInternalObject().isSleeping())
 		return ActivationState::Asleep;
 	return ActivationState::Active;
@@ -277,42 +460,49 @@ pragma::physics::ICollisionObject::ActivationState pragma::physics::PhysXRigidDy
 
 void pragma::physics::PhysXRigidDynamic::ApplyForce(const Vector3 &force, bool autoWake)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(IsKinematic())
 		return;
 	GetInternalObject().addForce(GetPxEnv().ToPhysXVector(force), physx::PxForceMode::eFORCE, autoWake);
 }
 void pragma::physics::PhysXRigidDynamic::ApplyForce(const Vector3 &force, const Vector3 &relPos, bool autoWake)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(IsKinematic())
 		return;
 	physx::PxRigidBodyExt::addForceAtLocalPos(GetInternalObject(), GetPxEnv().ToPhysXVector(force), GetPxEnv().ToPhysXVector(relPos), physx::PxForceMode::eFORCE, autoWake);
 }
 void pragma::physics::PhysXRigidDynamic::ApplyImpulse(const Vector3 &impulse, bool autoWake)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(IsKinematic())
 		return;
 	GetInternalObject().addForce(GetPxEnv().ToPhysXVector(impulse), physx::PxForceMode::eIMPULSE, autoWake);
 }
 void pragma::physics::PhysXRigidDynamic::ApplyImpulse(const Vector3 &impulse, const Vector3 &relPos, bool autoWake)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(IsKinematic())
 		return;
 	physx::PxRigidBodyExt::addForceAtLocalPos(GetInternalObject(), GetPxEnv().ToPhysXVector(impulse), GetPxEnv().ToPhysXVector(relPos), physx::PxForceMode::eIMPULSE, autoWake);
 }
 void pragma::physics::PhysXRigidDynamic::ApplyTorque(const Vector3 &torque, bool autoWake)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(IsKinematic())
 		return;
 	GetInternalObject().addTorque(GetPxEnv().ToPhysXTorque(torque), physx::PxForceMode::eFORCE, autoWake);
 }
 void pragma::physics::PhysXRigidDynamic::ApplyTorqueImpulse(const Vector3 &torque, bool autoWake)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(IsKinematic())
 		return;
 	GetInternalObject().addTorque(GetPxEnv().ToPhysXTorque(torque), physx::PxForceMode::eIMPULSE, autoWake);
 }
 void pragma::physics::PhysXRigidDynamic::ClearForces()
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	GetInternalObject().clearForce(physx::PxForceMode::eACCELERATION);
 	GetInternalObject().clearForce(physx::PxForceMode::eVELOCITY_CHANGE);
 	GetInternalObject().clearTorque(physx::PxForceMode::eACCELERATION);
@@ -328,11 +518,24 @@ Vector3 pragma::physics::PhysXRigidDynamic::GetTotalTorque() const
 	// TODO
 	return Vector3 {};
 }
-float pragma::physics::PhysXRigidDynamic::GetMass() const { return GetInternalObject().getMass(); }
-void pragma::physics::PhysXRigidDynamic::SetMass(float mass) { GetInternalObject().setMass(mass); }
-void pragma::physics::PhysXRigidDynamic::SetMassAndUpdateInertia(float mass) { physx::PxRigidBodyExt::setMassAndUpdateInertia(static_cast<physx::PxRigidBody &>(GetInternalObject()), mass); }
+float pragma::physics::PhysXRigidDynamic::GetMass() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getMass();
+}
+void pragma::physics::PhysXRigidDynamic::SetMass(float mass)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setMass(mass);
+}
+void pragma::physics::PhysXRigidDynamic::SetMassAndUpdateInertia(float mass)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	physx::PxRigidBodyExt::setMassAndUpdateInertia(static_cast<physx::PxRigidBody &>(GetInternalObject()), mass);
+}
 Vector3 pragma::physics::PhysXRigidDynamic::GetInertia()
 {
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
 	auto inertiaTensor = static_cast<physx::PxRigidBody &>(GetInternalObject()).getMassSpaceInertiaTensor();
 	return GetPxEnv().FromPhysXVector(inertiaTensor * umath::pow2(util::pragma::units_to_metres(1.f)));
 }
@@ -344,20 +547,35 @@ Mat3 pragma::physics::PhysXRigidDynamic::GetInvInertiaTensorWorld() const
 }
 void pragma::physics::PhysXRigidDynamic::SetInertia(const Vector3 &inertia)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto inertiaTensor = GetPxEnv().ToPhysXVector(inertia) / umath::pow2(util::pragma::units_to_metres(1.f));
 	static_cast<physx::PxRigidBody &>(GetInternalObject()).setMassSpaceInertiaTensor(inertiaTensor);
 }
-Vector3 pragma::physics::PhysXRigidDynamic::GetCenterOfMass() const { return GetPxEnv().FromPhysXVector(GetInternalObject().getCMassLocalPose().p); }
-Vector3 pragma::physics::PhysXRigidDynamic::GetLinearVelocity() const { return GetPxEnv().FromPhysXVector(GetInternalObject().getLinearVelocity()); }
-Vector3 pragma::physics::PhysXRigidDynamic::GetAngularVelocity() const { return GetPxEnv().FromPhysXVector(GetInternalObject().getAngularVelocity()); }
+Vector3 pragma::physics::PhysXRigidDynamic::GetCenterOfMass() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetPxEnv().FromPhysXVector(GetInternalObject().getCMassLocalPose().p);
+}
+Vector3 pragma::physics::PhysXRigidDynamic::GetLinearVelocity() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetPxEnv().FromPhysXVector(GetInternalObject().getLinearVelocity());
+}
+Vector3 pragma::physics::PhysXRigidDynamic::GetAngularVelocity() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetPxEnv().FromPhysXVector(GetInternalObject().getAngularVelocity());
+}
 void pragma::physics::PhysXRigidDynamic::SetLinearVelocity(const Vector3 &vel, bool autoWake)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(IsKinematic())
 		return;
 	GetInternalObject().setLinearVelocity(GetPxEnv().ToPhysXVector(vel), autoWake);
 }
 void pragma::physics::PhysXRigidDynamic::SetAngularVelocity(const Vector3 &vel, bool autoWake)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	if(IsKinematic())
 		return;
 	GetInternalObject().setAngularVelocity(GetPxEnv().ToPhysXVector(vel), autoWake);
@@ -380,44 +598,100 @@ Vector3 pragma::physics::PhysXRigidDynamic::GetAngularFactor() const
 	// TODO
 	return Vector3 {};
 }
-void pragma::physics::PhysXRigidDynamic::SetLinearDamping(float damping) { GetInternalObject().setLinearDamping(damping); }
-void pragma::physics::PhysXRigidDynamic::SetAngularDamping(float damping) { GetInternalObject().setAngularDamping(damping); }
-float pragma::physics::PhysXRigidDynamic::GetLinearDamping() const { return GetInternalObject().getLinearDamping(); }
-float pragma::physics::PhysXRigidDynamic::GetAngularDamping() const { return GetInternalObject().getAngularDamping(); }
-void pragma::physics::PhysXRigidDynamic::SetLinearSleepingThreshold(float threshold) { GetInternalObject().setSleepThreshold(threshold); }
+void pragma::physics::PhysXRigidDynamic::SetLinearDamping(float damping)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setLinearDamping(damping);
+}
+void pragma::physics::PhysXRigidDynamic::SetAngularDamping(float damping)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setAngularDamping(damping);
+}
+float pragma::physics::PhysXRigidDynamic::GetLinearDamping() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getLinearDamping();
+}
+float pragma::physics::PhysXRigidDynamic::GetAngularDamping() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getAngularDamping();
+}
+void pragma::physics::PhysXRigidDynamic::SetLinearSleepingThreshold(float threshold)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setSleepThreshold(threshold);
+}
 void pragma::physics::PhysXRigidDynamic::SetAngularSleepingThreshold(float threshold)
 {
 	// Not available in PhysX
 }
-float pragma::physics::PhysXRigidDynamic::GetLinearSleepingThreshold() const { return GetInternalObject().getSleepThreshold(); }
-float pragma::physics::PhysXRigidDynamic::GetAngularSleepingThreshold() const { return GetInternalObject().getSleepThreshold(); }
+float pragma::physics::PhysXRigidDynamic::GetLinearSleepingThreshold() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getSleepThreshold();
+}
+float pragma::physics::PhysXRigidDynamic::GetAngularSleepingThreshold() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getSleepThreshold();
+}
 void pragma::physics::PhysXRigidDynamic::SetCenterOfMassOffset(const Vector3 &offset)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto pose = GetInternalObject().getCMassLocalPose();
 	pose.p = GetPxEnv().ToPhysXVector(offset);
 	GetInternalObject().setCMassLocalPose(pose);
 }
 Vector3 pragma::physics::PhysXRigidDynamic::GetCenterOfMassOffset() const
 {
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
 	auto pose = GetInternalObject().getCMassLocalPose();
 	return GetPxEnv().FromPhysXVector(pose.p);
 }
-void pragma::physics::PhysXRigidDynamic::SetKinematic(bool bKinematic) { GetInternalObject().setRigidBodyFlag(physx::PxRigidBodyFlag::eKINEMATIC, bKinematic); }
-bool pragma::physics::PhysXRigidDynamic::IsKinematic() const { return GetInternalObject().getRigidBodyFlags().isSet(physx::PxRigidBodyFlag::eKINEMATIC); }
-void pragma::physics::PhysXRigidDynamic::WakeUp(bool forceActivation) { GetInternalObject().wakeUp(); }
-void pragma::physics::PhysXRigidDynamic::PutToSleep() { GetInternalObject().putToSleep(); }
-bool pragma::physics::PhysXRigidDynamic::IsStatic() const { return GetInternalObject().getRigidBodyFlags().isSet(physx::PxRigidBodyFlag::eKINEMATIC); }
+void pragma::physics::PhysXRigidDynamic::SetKinematic(bool bKinematic)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setRigidBodyFlag(physx::PxRigidBodyFlag::eKINEMATIC, bKinematic);
+}
+bool pragma::physics::PhysXRigidDynamic::IsKinematic() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getRigidBodyFlags().isSet(physx::PxRigidBodyFlag::eKINEMATIC);
+}
+void pragma::physics::PhysXRigidDynamic::WakeUp(bool forceActivation)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().wakeUp();
+}
+void pragma::physics::PhysXRigidDynamic::PutToSleep()
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().putToSleep();
+}
+bool pragma::physics::PhysXRigidDynamic::IsStatic() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getRigidBodyFlags().isSet(physx::PxRigidBodyFlag::eKINEMATIC);
+}
 void pragma::physics::PhysXRigidDynamic::SetStatic(bool b)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	// Dynamic rigid bodies cannot be transformed into static rigid bodies in PhysX,
 	// so we'll just turn it into a kinematic object instead.
 	if(b)
 		SetCCDEnabled(false); // CCD is not supported for kinematic objects
 	GetInternalObject().setRigidBodyFlag(physx::PxRigidBodyFlag::eKINEMATIC, b);
 }
-void pragma::physics::PhysXRigidDynamic::SetCCDEnabled(bool b) { GetInternalObject().setRigidBodyFlag(physx::PxRigidBodyFlag::eENABLE_CCD, b); }
+void pragma::physics::PhysXRigidDynamic::SetCCDEnabled(bool b)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setRigidBodyFlag(physx::PxRigidBodyFlag::eENABLE_CCD, b);
+}
 void pragma::physics::PhysXRigidDynamic::ApplyCollisionShape(pragma::physics::IShape *optShape)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	PhysXRigidBody::ApplyCollisionShape(optShape);
 	if(optShape == nullptr)
 		return;
@@ -475,5 +749,104 @@ bool pragma::physics::PhysXRigidStatic::IsKinematic() const { return false; }
 
 //////////////////
 
+pragma::physics::PhysXGhostObject::PhysXGhostObject(IEnvironment &env, PhysXUniquePtr<physx::PxActor> actor, IShape &shape) : PhysXCollisionObject {env, std::move(actor), shape}, IGhostObject {env, shape}, ICollisionObject {env, shape} {}
+physx::PxRigidDynamic &pragma::physics::PhysXGhostObject::GetInternalObject() const { return static_cast<physx::PxRigidDynamic &>(PhysXCollisionObject::GetInternalObject()); }
+const pragma::physics::PhysXCollisionObject::TouchingSet &pragma::physics::PhysXGhostObject::GetOverlappingObjects() const { return GetTouchingObjects(); }
+uint32_t pragma::physics::PhysXGhostObject::GetOverlappingObjectCount() const { return GetTouchingObjectCount(); }
+void pragma::physics::PhysXGhostObject::SetContactProcessingThreshold(float threshold) {}
+void pragma::physics::PhysXGhostObject::SetGlobalPose(const physx::PxTransform &pose)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	auto &o = GetInternalObject();
+	// Moving the kinematic target (instead of teleporting) lets the broadphase update the overlaps incrementally
+	if(o.getScene() && IsSimulationEnabled())
+		o.setKinematicTarget(pose);
+	else
+		o.setGlobalPose(pose);
+}
+Vector3 pragma::physics::PhysXGhostObject::GetPos() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetPxEnv().FromPhysXVector(GetInternalObject().getGlobalPose().p);
+}
+void pragma::physics::PhysXGhostObject::SetPos(const Vector3 &pos)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	auto pose = GetInternalObject().getGlobalPose();
+	pose.p = GetPxEnv().ToPhysXVector(pos);
+	SetGlobalPose(pose);
+}
+Quat pragma::physics::PhysXGhostObject::GetRotation() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetPxEnv().FromPhysXRotation(GetInternalObject().getGlobalPose().q);
+}
+void pragma::physics::PhysXGhostObject::SetRotation(const Quat &rot)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	auto pose = GetInternalObject().getGlobalPose();
+	pose.q = GetPxEnv().ToPhysXRotation(rot);
+	SetGlobalPose(pose);
+}
+umath::Transform pragma::physics::PhysXGhostObject::GetWorldTransform()
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetPxEnv().CreateTransform(GetInternalObject().getGlobalPose());
+}
+void pragma::physics::PhysXGhostObject::SetWorldTransform(const umath::Transform &t) { SetGlobalPose(GetPxEnv().CreatePxTransform(t)); }
+umath::Transform pragma::physics::PhysXGhostObject::GetBaseTransform() { return GetWorldTransform(); }
+void pragma::physics::PhysXGhostObject::SetBaseTransform(const umath::Transform &t) { SetWorldTransform(t); }
+void pragma::physics::PhysXGhostObject::SetSimulationEnabled(bool b)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setActorFlag(physx::PxActorFlag::eDISABLE_SIMULATION, !b);
+}
+bool pragma::physics::PhysXGhostObject::IsSimulationEnabled() const
+{
+	PhysXEnvironment::SceneReadScope lock {GetPxEnv()};
+	return GetInternalObject().getActorFlags().isSet(physx::PxActorFlag::eDISABLE_SIMULATION) == false;
+}
+void pragma::physics::PhysXGhostObject::SetCollisionsEnabled(bool enabled) { SetSimulationEnabled(enabled); }
+void pragma::physics::PhysXGhostObject::SetActivationState(ActivationState state) {}
+pragma::physics::ICollisionObject::ActivationState pragma::physics::PhysXGhostObject::GetActivationState() const { return ActivationState::Active; }
+bool pragma::physics::PhysXGhostObject::IsStatic() const { return false; }
+void pragma::physics::PhysXGhostObject::SetStatic(bool b) {}
+// The sleep state of kinematic actors can't be changed directly, they are woken up whenever a new kinematic target is set
+void pragma::physics::PhysXGhostObject::WakeUp(bool forceActivation) {}
+void pragma::physics::PhysXGhostObject::PutToSleep() {}
+void pragma::physics::PhysXGhostObject::SetCCDEnabled(bool b) {}
+void pragma::physics::PhysXGhostObject::ApplyCollisionShape(pragma::physics::IShape *optShape)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	AttachCollisionShape(optShape);
+	// PhysX doesn't support triangle mesh or heightfield trigger shapes
+	auto &actorShapes = m_actorShapeCollection.GetActorShapes();
+	auto itUnsupported = std::find_if(actorShapes.begin(), actorShapes.end(), [](const std::unique_ptr<PhysXActorShape> &actorShape) {
+		auto type = actorShape->GetActorShape().getGeometry().getType();
+		return type == physx::PxGeometryType::eTRIANGLEMESH || type == physx::PxGeometryType::eHEIGHTFIELD;
+	});
+	if(itUnsupported != actorShapes.end()) {
+		Con::cwar << "[PhysX] Triangle mesh and heightfield shapes cannot be used for ghost objects!" << Con::endl;
+		AttachCollisionShape(nullptr);
+		return;
+	}
+	m_actorShapeCollection.SetTrigger(true);
+	for(auto &actorShape : m_actorShapeCollection.GetActorShapes()) {
+		auto &pxActorShape = actorShape->GetActorShape();
+		pxActorShape.setFlag(physx::PxShapeFlag::eSCENE_QUERY_SHAPE, false);
+
+		auto simFilterData = pxActorShape.getSimulationFilterData();
+		simFilterData.word2 |= umath::to_integral(PhysXSimulationFilterFlags::GhostObject);
+		pxActorShape.setSimulationFilterData(simFilterData);
+	}
+	auto *scene = GetInternalObject().getScene();
+	if(scene)
+		scene->resetFiltering(static_cast<physx::PxActor &>(GetInternalObject()));
+}
+void pragma::physics::PhysXGhostObject::DoSetCollisionFilterGroup(CollisionMask group) { ApplyCollisionFilterGroup(group); }
+void pragma::physics::PhysXGhostObject::DoSetCollisionFilterMask(CollisionMask mask) { ApplyCollisionFilterMask(mask); }
+
+//////////////////
+
 pragma::physics::PhysXSoftBody::PhysXSoftBody(IEnvironment &env, PhysXUniquePtr<physx::PxActor> actor, IShape &shape) : ISoftBody {env, shape, {}}, PhysXCollisionObject {env, std::move(actor), shape} {}
 physx::PxActor &pragma::physics::PhysXSoftBody::GetInternalObject() const { return PhysXCollisionObject::GetInternalObject(); }
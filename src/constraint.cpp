@@ -18,9 +18,14 @@ void pragma::physics::PhysXConstraint::RemoveWorldObject() {}
 void pragma::physics::PhysXConstraint::DoAddWorldObject() {}
 physx::PxJoint &pragma::physics::PhysXConstraint::GetInternalObject() const { return *m_joint; }
 pragma::physics::PhysXEnvironment &pragma::physics::PhysXConstraint::GetPxEnv() const { return static_cast<PhysXEnvironment &>(m_physEnv); }
-void pragma::physics::PhysXConstraint::DoSetCollisionsEnabled(Bool b) { GetInternalObject().setConstraintFlag(physx::PxConstraintFlag::eCOLLISION_ENABLED, b); }
+void pragma::physics::PhysXConstraint::DoSetCollisionsEnabled(Bool b)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setConstraintFlag(physx::PxConstraintFlag::eCOLLISION_ENABLED, b);
+}
 void pragma::physics::PhysXConstraint::SetEnabled(bool b)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	umath::set_flag(m_stateFlags, StateFlags::Enabled, b);
 	if(IsBroken())
 		return;
@@ -29,6 +34,7 @@ void pragma::physics::PhysXConstraint::SetEnabled(bool b)
 bool pragma::physics::PhysXConstraint::IsEnabled() const { return umath::is_flag_set(m_stateFlags, StateFlags::Enabled); }
 void pragma::physics::PhysXConstraint::Break()
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	umath::set_flag(m_stateFlags, StateFlags::Broken);
 	GetInternalObject().setConstraintFlag(physx::PxConstraintFlag::eBROKEN, true);
 }
@@ -61,6 +67,7 @@ float pragma::physics::PhysXConstraint::GetBreakForce() const
 }
 void pragma::physics::PhysXConstraint::SetBreakForce(float force)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	physx::PxReal oldForce, torque;
 	GetInternalObject().getBreakForce(oldForce, torque);
 	GetInternalObject().setBreakForce(GetPxEnv().ToPhysXLength(force), torque);
@@ -73,6 +80,7 @@ float pragma::physics::PhysXConstraint::GetBreakTorque() const
 }
 void pragma::physics::PhysXConstraint::SetBreakTorque(float torque)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	physx::PxReal force, oldTorque;
 	GetInternalObject().getBreakForce(force, oldTorque);
 	GetInternalObject().setBreakForce(force, GetPxEnv().ToPhysXTorque(torque));
@@ -107,6 +115,7 @@ pragma::physics::PhysXHingeConstraint::PhysXHingeConstraint(IEnvironment &env, P
 physx::PxRevoluteJoint &pragma::physics::PhysXHingeConstraint::GetInternalObject() const { return static_cast<physx::PxRevoluteJoint &>(PhysXConstraint::GetInternalObject()); }
 void pragma::physics::PhysXHingeConstraint::UpdateLimits()
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto limit = GetInternalObject().getLimit();
 	limit.lower = m_lowerLimit;
 	limit.upper = m_upperLimit;
@@ -117,6 +126,7 @@ void pragma::physics::PhysXHingeConstraint::UpdateLimits()
 }
 void pragma::physics::PhysXHingeConstraint::SetLimit(umath::Radian lowerLimit, umath::Radian upperLimit)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	m_lowerLimit = lowerLimit;
 	m_upperLimit = upperLimit;
 	UpdateLimits();
@@ -134,7 +144,11 @@ void pragma::physics::PhysXHingeConstraint::SetDamping(float damping)
 	m_damping = damping;
 	UpdateLimits();
 }
-void pragma::physics::PhysXHingeConstraint::DisableLimit() { GetInternalObject().setRevoluteJointFlag(physx::PxRevoluteJointFlag::eLIMIT_ENABLED, false); }
+void pragma::physics::PhysXHingeConstraint::DisableLimit()
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setRevoluteJointFlag(physx::PxRevoluteJointFlag::eLIMIT_ENABLED, false);
+}
 float pragma::physics::PhysXHingeConstraint::GetSoftness() const { return m_softness; }
 float pragma::physics::PhysXHingeConstraint::GetDamping() const { return m_damping; }
 void pragma::physics::PhysXHingeConstraint::SetRestitution(float restitution)
@@ -158,6 +172,7 @@ pragma::physics::PhysXSliderConstraint::PhysXSliderConstraint(IEnvironment &env,
 physx::PxPrismaticJoint &pragma::physics::PhysXSliderConstraint::GetInternalObject() const { return static_cast<physx::PxPrismaticJoint &>(PhysXConstraint::GetInternalObject()); }
 void pragma::physics::PhysXSliderConstraint::UpdateLimits()
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto limit = GetInternalObject().getLimit();
 	limit.lower = m_lowerLimit;
 	limit.upper = m_upperLimit;
@@ -168,12 +183,17 @@ void pragma::physics::PhysXSliderConstraint::UpdateLimits()
 }
 void pragma::physics::PhysXSliderConstraint::SetLimit(float lowerLimit, float upperLimit)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	m_lowerLimit = lowerLimit;
 	m_upperLimit = upperLimit;
 	UpdateLimits();
 	GetInternalObject().setPrismaticJointFlag(physx::PxPrismaticJointFlag::eLIMIT_ENABLED, true);
 }
-void pragma::physics::PhysXSliderConstraint::DisableLimit() { GetInternalObject().setPrismaticJointFlag(physx::PxPrismaticJointFlag::eLIMIT_ENABLED, false); }
+void pragma::physics::PhysXSliderConstraint::DisableLimit()
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	GetInternalObject().setPrismaticJointFlag(physx::PxPrismaticJointFlag::eLIMIT_ENABLED, false);
+}
 void pragma::physics::PhysXSliderConstraint::SetSoftness(float softness)
 {
 	m_softness = softness;
@@ -221,6 +241,7 @@ pragma::physics::PhysXConeTwistConstraint::PhysXConeTwistConstraint(IEnvironment
 physx::PxD6Joint &pragma::physics::PhysXConeTwistConstraint::GetInternalObject() const { return static_cast<physx::PxD6Joint &>(PhysXConstraint::GetInternalObject()); }
 void pragma::physics::PhysXConeTwistConstraint::UpdateLocalPoses()
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto centerLimits = Vector2 {(m_lowerLimits.x + m_upperLimits.x) / 2.f, (m_lowerLimits.y + m_upperLimits.y) / 2.f};
 	auto pose0 = m_localPoses.front();
 	pose0.q *= uquat::create_px(uquat::create(EulerAngles {centerLimits.x, centerLimits.y, 0.f}));
@@ -231,6 +252,7 @@ void pragma::physics::PhysXConeTwistConstraint::UpdateLocalPoses()
 }
 void pragma::physics::PhysXConeTwistConstraint::UpdateLimits()
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	Vector2 swingSpan = {m_upperLimits.x - m_lowerLimits.x, m_upperLimits.y - m_lowerLimits.y};
 	auto swingLimit = GetInternalObject().getSwingLimit();
 	swingLimit.yAngle = swingSpan.x;
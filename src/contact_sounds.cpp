@@ -0,0 +1,177 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/contact_sounds.hpp"
+#include "pr_physx/environment.hpp"
+#include "pr_physx/collision_object.hpp"
+#include "pr_physx/material.hpp"
+#include <algorithm>
+
+pragma::physics::PhysXContactSoundService::PhysXContactSoundService(PhysXEnvironment &env) : m_env {env} {}
+
+void pragma::physics::PhysXContactSoundService::AddBody(ICollisionObject &colObj)
+{
+	if(FindBody(colObj))
+		return;
+	auto &body = m_bodies[&colObj];
+	body = {};
+	body.handle = util::weak_shared_handle_cast<IBase, ICollisionObject>(colObj.GetHandle());
+	PhysXCollisionObject::GetCollisionObject(colObj).AddImpactReportListener();
+}
+void pragma::physics::PhysXContactSoundService::RemoveBody(ICollisionObject &colObj)
+{
+	auto it = m_bodies.find(&colObj);
+	if(it == m_bodies.end())
+		return;
+	auto valid = (it->second.handle.Get() == &colObj);
+	m_bodies.erase(it);
+	if(valid)
+		PhysXCollisionObject::GetCollisionObject(colObj).RemoveImpactReportListener();
+}
+bool pragma::physics::PhysXContactSoundService::HasBody(const ICollisionObject &colObj) const { return m_bodies.find(&colObj) != m_bodies.end(); }
+void pragma::physics::PhysXContactSoundService::Clear()
+{
+	for(auto &pair : m_bodies) {
+		auto *colObj = pair.second.handle.Get();
+		if(colObj)
+			PhysXCollisionObject::GetCollisionObject(*colObj).RemoveImpactReportListener();
+	}
+	m_bodies.clear();
+	m_candidates.clear();
+}
+
+void pragma::physics::PhysXContactSoundService::SetSettings(const Settings &settings) { m_settings = settings; }
+const pragma::physics::PhysXContactSoundService::Settings &pragma::physics::PhysXContactSoundService::GetSettings() const { return m_settings; }
+
+void pragma::physics::PhysXContactSoundService::SetSoundCallback(const SoundCallback &callback) { m_soundCallback = callback; }
+const std::vector<pragma::physics::PhysXContactSoundService::SoundEvent> &pragma::physics::PhysXContactSoundService::GetSoundEvents() const { return m_events; }
+
+pragma::physics::PhysXContactSoundService::Body *pragma::physics::PhysXContactSoundService::FindBody(const ICollisionObject &colObj)
+{
+	auto it = m_bodies.find(&colObj);
+	// The address may have been re-used by a different object if the body was removed without unregistering it
+	if(it == m_bodies.end() || it->second.handle.Get() != &colObj)
+		return nullptr;
+	return &it->second;
+}
+
+void pragma::physics::PhysXContactSoundService::AddCandidate(Body &body, EventType type, ICollisionObject &other, PhysXMaterial *material0, PhysXMaterial *material1, const Vector3 &position, float intensity)
+{
+	auto it = std::find_if(body.channels.begin(), body.channels.end(), [type, material0, material1](const Channel &channel) { return channel.type == type && channel.material0 == material0 && channel.material1 == material1; });
+	if(it == body.channels.end()) {
+		body.channels.push_back({material0, material1, type});
+		it = body.channels.end() - 1;
+	}
+	auto &channel = *it;
+	if(m_env.GetSimulationTime() - channel.lastEventTime < m_settings.minInterval)
+		return;
+	// Only the most intense contact of a channel is kept per step
+	if(channel.candidate != -1) {
+		auto &candidate = m_candidates[channel.candidate];
+		if(intensity > candidate.intensity) {
+			candidate.other = util::weak_shared_handle_cast<IBase, ICollisionObject>(other.GetHandle());
+			candidate.position = position;
+			candidate.intensity = intensity;
+		}
+		return;
+	}
+	channel.candidate = m_candidates.size();
+	m_candidates.push_back({});
+	auto &candidate = m_candidates.back();
+	candidate.body = body.handle;
+	candidate.channel = it - body.channels.begin();
+	candidate.other = util::weak_shared_handle_cast<IBase, ICollisionObject>(other.GetHandle());
+	candidate.material0 = material0;
+	candidate.material1 = material1;
+	candidate.position = position;
+	candidate.intensity = intensity;
+}
+
+void pragma::physics::PhysXContactSoundService::AddContact(ICollisionObject &colObj0, ICollisionObject &colObj1, PhysXMaterial *material0, PhysXMaterial *material1, float impulse, const Vector3 &position, const Vector3 &normal)
+{
+	auto *body0 = FindBody(colObj0);
+	auto *body1 = FindBody(colObj1);
+	if(body0 == nullptr && body1 == nullptr)
+		return;
+
+	// Velocity of the body at the contact point and its inverse mass
+	auto pxPos = m_env.ToPhysXVector(position);
+	auto getPointVelocity = [this, &pxPos](ICollisionObject &colObj, float &outInvMass) -> physx::PxVec3 {
+		PhysXEnvironment::SceneReadScope lock {m_env};
+		// The object may have been removed from the world by a contact callback
+		auto &o = PhysXCollisionObject::GetCollisionObject(colObj);
+		auto *rigidBody = o.HasInternalObject() ? o.GetInternalObject().is<physx::PxRigidBody>() : nullptr;
+		if(rigidBody == nullptr) {
+			outInvMass = 0.f;
+			return physx::PxVec3 {0.f};
+		}
+		outInvMass = rigidBody->getRigidBodyFlags().isSet(physx::PxRigidBodyFlag::eKINEMATIC) ? 0.f : rigidBody->getInvMass();
+		auto centerOfMass = rigidBody->getGlobalPose() * rigidBody->getCMassLocalPose();
+		return rigidBody->getLinearVelocity() + rigidBody->getAngularVelocity().cross(pxPos - centerOfMass.p);
+	};
+	float invMass0, invMass1;
+	auto relVel = m_env.FromPhysXVector(getPointVelocity(colObj0, invMass0) - getPointVelocity(colObj1, invMass1));
+
+	// The normal impulse corresponds to the change in relative velocity along the normal. For impacts the velocities
+	// before the step would be required, but those are not available anymore after the solver has run.
+	auto impactSpeed = impulse * (invMass0 + invMass1);
+	auto tangentialVel = relVel - normal * uvec::dot(relVel, normal);
+	auto scrapeSpeed = uvec::length(tangentialVel);
+
+	EventType type;
+	float intensity;
+	if(impactSpeed >= m_settings.minImpactSpeed) {
+		type = EventType::Impact;
+		intensity = impactSpeed;
+	}
+	else if(scrapeSpeed >= m_settings.minScrapeSpeed) {
+		type = EventType::Scrape;
+		intensity = scrapeSpeed;
+	}
+	else
+		return;
+	// If both bodies are registered, only one event is generated for the pair
+	if(body0)
+		AddCandidate(*body0, type, colObj1, material0, material1, position, intensity);
+	else
+		AddCandidate(*body1, type, colObj0, material1, material0, position, intensity);
+}
+
+void pragma::physics::PhysXContactSoundService::DispatchEvents()
+{
+	m_events.clear();
+	if(m_candidates.empty())
+		return;
+	auto numEvents = std::min<size_t>(m_candidates.size(), m_settings.maxEventsPerStep);
+	std::partial_sort(m_candidates.begin(), m_candidates.begin() + numEvents, m_candidates.end(), [](const Candidate &a, const Candidate &b) { return a.intensity > b.intensity; });
+
+	auto t = m_env.GetSimulationTime();
+	auto getMaterial = [](PhysXMaterial *material) -> std::shared_ptr<IMaterial> { return material ? std::static_pointer_cast<IMaterial>(material->shared_from_this()) : nullptr; };
+	m_events.reserve(numEvents);
+	for(auto i = decltype(m_candidates.size()) {0u}; i < m_candidates.size(); ++i) {
+		auto &candidate = m_candidates[i];
+		auto *colObj = candidate.body.Get();
+		auto *body = colObj ? FindBody(*colObj) : nullptr;
+		if(body == nullptr || candidate.channel >= body->channels.size())
+			continue;
+		auto &channel = body->channels[candidate.channel];
+		channel.candidate = -1;
+		// Events that didn't fit into the budget are dropped without affecting the rate limit
+		if(i >= numEvents)
+			continue;
+		channel.lastEventTime = t;
+		m_events.push_back({});
+		auto &ev = m_events.back();
+		ev.type = channel.type;
+		ev.collisionObject0 = body->handle;
+		ev.collisionObject1 = candidate.other;
+		ev.material0 = getMaterial(candidate.material0);
+		ev.material1 = getMaterial(candidate.material1);
+		ev.position = candidate.position;
+		ev.intensity = candidate.intensity;
+	}
+	m_candidates.clear();
+	if(m_events.empty() == false && m_soundCallback)
+		m_soundCallback(m_events);
+}
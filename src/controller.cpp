@@ -69,6 +69,7 @@ std::optional<Vector3> pragma::physics::PhysXController::GetGroundTouchNormal()
 pragma::physics::IController::CollisionFlags pragma::physics::PhysXController::GetCollisionFlags() const { return m_collisionFlags; }
 void pragma::physics::PhysXController::MoveController(const Vector3 &displacement, bool testOnly)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	physx::PxFilterData filterData {0, 0, 0, 0};
 	physx::PxControllerFilters filters {};
 	filters.mCCTFilterCallback = g_filterCallback.get();
@@ -79,9 +80,17 @@ void pragma::physics::PhysXController::MoveController(const Vector3 &displacemen
 	m_controller->getState(m_controllerState);
 }
 void pragma::physics::PhysXController::DoMove(Vector3 &disp) { MoveController(disp, false); }
-void pragma::physics::PhysXController::SetPos(const Vector3 &pos) { m_controller->setPosition(GetPxEnv().ToPhysXExtendedVector(pos)); }
+void pragma::physics::PhysXController::SetPos(const Vector3 &pos)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	m_controller->setPosition(GetPxEnv().ToPhysXExtendedVector(pos));
+}
 Vector3 pragma::physics::PhysXController::GetPos() const { return GetPxEnv().FromPhysXVector(m_controller->getPosition()); }
-void pragma::physics::PhysXController::SetFootPos(const Vector3 &footPos) { m_controller->setFootPosition(GetPxEnv().ToPhysXExtendedVector(footPos)); }
+void pragma::physics::PhysXController::SetFootPos(const Vector3 &footPos)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	m_controller->setFootPosition(GetPxEnv().ToPhysXExtendedVector(footPos));
+}
 Vector3 pragma::physics::PhysXController::GetFootPos() const { return GetPxEnv().FromPhysXVector(m_controller->getFootPosition()); }
 void pragma::physics::PhysXController::SetUpDirection(const Vector3 &up) { m_controller->setUpDirection(GetPxEnv().ToPhysXNormal(up)); }
 Vector3 pragma::physics::PhysXController::GetUpDirection() const { return GetPxEnv().FromPhysXNormal(m_controller->getUpDirection()); }
@@ -110,6 +119,7 @@ Vector3 pragma::physics::PhysXController::GetDimensions() const
 }
 void pragma::physics::PhysXController::SetDimensions(const Vector3 &dimensions)
 {
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto footPos = m_controller->getFootPosition();
 	auto pxDim = GetPxEnv().ToPhysXVector(dimensions);
 	switch(m_controller->getType()) {
@@ -131,7 +141,11 @@ void pragma::physics::PhysXController::SetDimensions(const Vector3 &dimensions)
 	}
 	m_controller->setFootPosition(footPos);
 }
-void pragma::physics::PhysXController::Resize(float newHeight) { m_controller->resize(newHeight); }
+void pragma::physics::PhysXController::Resize(float newHeight)
+{
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
+	m_controller->resize(newHeight);
+}
 Vector3 pragma::physics::PhysXController::GetLinearVelocity() const { return m_velocity; }
 void pragma::physics::PhysXController::SetLinearVelocity(const Vector3 &vel) { m_velocity = vel; }
 void pragma::physics::PhysXController::PreSimulate(float dt)
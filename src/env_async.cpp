@@ -0,0 +1,262 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/async.hpp"
+#include "pr_physx/environment.hpp"
+#include "pr_physx/controller.hpp"
+#include "pr_physx/vehicle.hpp"
+#include "pr_physx/query_profiler.hpp"
+#include "pr_physx/pose_history.hpp"
+#include "pr_physx/projectiles.hpp"
+#include "pr_physx/impact_damage.hpp"
+#include "pr_physx/contact_sounds.hpp"
+#include "pr_physx/sleep_state.hpp"
+#include "pr_physx/sim_event_callback.hpp"
+#include "pr_physx/collision_object.hpp"
+#include <algorithm>
+
+static constexpr uint32_t ASYNC_QUERY_BATCH_SIZE = 16;
+
+void pragma::physics::PhysXGameThreadExecutor::Post(std::coroutine_handle<> handle)
+{
+	std::scoped_lock lock {m_mutex};
+	m_pending.push_back(handle);
+}
+uint32_t pragma::physics::PhysXGameThreadExecutor::RunPending()
+{
+	{
+		std::scoped_lock lock {m_mutex};
+		m_running.swap(m_pending);
+	}
+	// Resumed coroutines may post new continuations, which will be resumed on the next call
+	uint32_t numResumed = m_running.size();
+	for(auto handle : m_running)
+		handle.resume();
+	m_running.clear();
+	return numResumed;
+}
+
+pragma::physics::AsyncQueryTask::AsyncQueryTask(PhysXAsyncQueryBatch &batch, uint32_t start, uint32_t end) : m_batch {batch}, m_start {start}, m_end {end} {}
+void pragma::physics::AsyncQueryTask::run()
+{
+	PhysXSceneQueryProfiler::TagScope tagScope {m_batch.tag};
+	auto &env = m_batch.env;
+	for(auto i = m_start; i < m_end; ++i) {
+		auto &data = m_batch.data[i];
+		auto &result = m_batch.results[i];
+		switch(m_batch.type) {
+		case AsyncQueryType::Overlap:
+			result.hit = env.Overlap(data, &result.results);
+			break;
+		case AsyncQueryType::RayCast:
+			result.hit = env.RayCast(data, &result.results);
+			break;
+		case AsyncQueryType::Sweep:
+			result.hit = env.Sweep(data, &result.results);
+			break;
+		}
+	}
+}
+void pragma::physics::AsyncQueryTask::release() { m_batch.env.OnAsyncQueryTaskCompleted(m_batch); }
+const char *pragma::physics::AsyncQueryTask::getName() const { return "pragma::physics::AsyncQueryTask"; }
+
+pragma::physics::PhysXAsyncQueryBatch::PhysXAsyncQueryBatch(PhysXEnvironment &env, AsyncQueryType type, std::vector<TraceData> &&data)
+    : env {env}, type {type}, data {std::move(data)}, results(this->data.size()), tag {PhysXSceneQueryProfiler::GetCurrentTag()}
+{
+}
+
+pragma::physics::AsyncQueryAwaitable::AsyncQueryAwaitable(PhysXEnvironment &env, AsyncQueryType type, std::vector<TraceData> &&data) : m_batch {std::make_unique<PhysXAsyncQueryBatch>(env, type, std::move(data))} {}
+pragma::physics::AsyncQueryAwaitable::~AsyncQueryAwaitable()
+{
+	// The batch is still referenced by the worker threads and the continuation by the executor
+	assert(m_suspended == false && "Coroutine destroyed while suspended on an asynchronous query!");
+}
+bool pragma::physics::AsyncQueryAwaitable::await_ready() const noexcept { return m_batch->data.empty(); }
+void pragma::physics::AsyncQueryAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+	m_suspended = true;
+	m_batch->continuation = handle;
+	m_batch->env.QueueAsyncQueries(*m_batch);
+}
+pragma::physics::AsyncQueryResult pragma::physics::AsyncSingleQueryAwaitable::await_resume()
+{
+	m_suspended = false;
+	return std::move(m_batch->results.front());
+}
+std::vector<pragma::physics::AsyncQueryResult> pragma::physics::AsyncBatchQueryAwaitable::await_resume()
+{
+	m_suspended = false;
+	return std::move(m_batch->results);
+}
+
+pragma::physics::AsyncStepAwaitable::AsyncStepAwaitable(PhysXEnvironment &env, float timeStep, float fixedTimeStep) : m_env {env}, m_timeStep {timeStep}, m_fixedTimeStep {fixedTimeStep} {}
+pragma::physics::AsyncStepAwaitable::~AsyncStepAwaitable() { assert(m_suspended == false && "Coroutine destroyed while suspended on an asynchronous step!"); }
+bool pragma::physics::AsyncStepAwaitable::await_ready() const noexcept { return false; }
+void pragma::physics::AsyncStepAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+	m_suspended = true;
+	m_env.BeginAsyncStep(m_timeStep, m_fixedTimeStep, handle);
+}
+
+pragma::physics::AsyncSingleQueryAwaitable pragma::physics::PhysXEnvironment::OverlapAsync(const TraceData &data) { return {*this, AsyncQueryType::Overlap, std::vector<TraceData> {data}}; }
+pragma::physics::AsyncSingleQueryAwaitable pragma::physics::PhysXEnvironment::RayCastAsync(const TraceData &data) { return {*this, AsyncQueryType::RayCast, std::vector<TraceData> {data}}; }
+pragma::physics::AsyncSingleQueryAwaitable pragma::physics::PhysXEnvironment::SweepAsync(const TraceData &data) { return {*this, AsyncQueryType::Sweep, std::vector<TraceData> {data}}; }
+pragma::physics::AsyncBatchQueryAwaitable pragma::physics::PhysXEnvironment::OverlapBatchAsync(std::vector<TraceData> data) { return {*this, AsyncQueryType::Overlap, std::move(data)}; }
+pragma::physics::AsyncBatchQueryAwaitable pragma::physics::PhysXEnvironment::RayCastBatchAsync(std::vector<TraceData> data) { return {*this, AsyncQueryType::RayCast, std::move(data)}; }
+pragma::physics::AsyncBatchQueryAwaitable pragma::physics::PhysXEnvironment::SweepBatchAsync(std::vector<TraceData> data) { return {*this, AsyncQueryType::Sweep, std::move(data)}; }
+pragma::physics::AsyncStepAwaitable pragma::physics::PhysXEnvironment::StepAsync(float timeStep, float fixedTimeStep) { return {*this, timeStep, fixedTimeStep}; }
+pragma::physics::PhysXGameThreadExecutor &pragma::physics::PhysXEnvironment::GetGameThreadExecutor() const { return m_asyncState->executor; }
+
+void pragma::physics::PhysXEnvironment::QueueAsyncQueries(PhysXAsyncQueryBatch &batch) { m_asyncState->queuedBatches.push_back(&batch); }
+void pragma::physics::PhysXEnvironment::DispatchAsyncQueries()
+{
+	auto &state = *m_asyncState;
+	if(state.queuedBatches.empty())
+		return;
+	for(auto *batch : state.queuedBatches) {
+		uint32_t numQueries = batch->data.size();
+		auto numTasks = (numQueries + ASYNC_QUERY_BATCH_SIZE - 1) / ASYNC_QUERY_BATCH_SIZE;
+		batch->numPendingTasks = numTasks;
+		{
+			std::scoped_lock lock {state.inFlightMutex};
+			state.numTasksInFlight += numTasks;
+		}
+		for(auto i = decltype(numTasks) {0u}; i < numTasks; ++i) {
+			auto start = i * ASYNC_QUERY_BATCH_SIZE;
+			batch->tasks.emplace_back(*batch, start, std::min(start + ASYNC_QUERY_BATCH_SIZE, numQueries));
+		}
+		for(auto &task : batch->tasks)
+			m_cpuDispatcher->submitTask(task);
+	}
+	state.queuedBatches.clear();
+}
+void pragma::physics::PhysXEnvironment::WaitForAsyncQueries()
+{
+	auto &state = *m_asyncState;
+	std::unique_lock lock {state.inFlightMutex};
+	state.inFlightCondition.wait(lock, [&state]() { return state.numTasksInFlight == 0; });
+}
+void pragma::physics::PhysXEnvironment::OnAsyncQueryTaskCompleted(PhysXAsyncQueryBatch &batch)
+{
+	// The batch may be destroyed as soon as the continuation has been resumed on the game thread,
+	// so it mustn't be accessed after posting the continuation
+	if(--batch.numPendingTasks == 0)
+		m_asyncState->executor.Post(batch.continuation);
+	auto &state = *m_asyncState;
+	std::scoped_lock lock {state.inFlightMutex};
+	if(--state.numTasksInFlight == 0)
+		state.inFlightCondition.notify_all();
+}
+
+void pragma::physics::PhysXEnvironment::QueueContactReportFilterUpdate(PhysXCollisionObject &o) { m_contactReportFilterUpdates.push_back(util::weak_shared_handle_cast<IBase, ICollisionObject>(o.GetHandle())); }
+void pragma::physics::PhysXEnvironment::UpdateContactReportFilters()
+{
+	// Only objects whose contact report state may have changed since the last step are queued
+	for(auto &hColObj : m_contactReportFilterUpdates) {
+		auto *colObj = hColObj.Get();
+		if(colObj)
+			PhysXCollisionObject::GetCollisionObject(*colObj).UpdateContactReportFilterFlags();
+	}
+	m_contactReportFilterUpdates.clear();
+}
+void pragma::physics::PhysXEnvironment::BeginSubStep(float timeStep)
+{
+	{
+		SceneWriteScope lock {*this};
+		UpdateContactReportFilters();
+		m_scene->simulate(timeStep);
+		m_simulating = true;
+	}
+	// The scene can't be modified while the simulation is running, so this is a safe window
+	// for the asynchronous queries
+	DispatchAsyncQueries();
+}
+void pragma::physics::PhysXEnvironment::EndSubStep(float timeStep)
+{
+	WaitForAsyncQueries();
+	{
+		SceneWriteScope lock {*this};
+		m_scene->fetchResults(true);
+		m_simulating = false;
+	}
+	m_simEventCallback->DispatchContacts();
+	m_simulationTime += timeStep;
+	m_poseHistory->Record(m_simulationTime);
+	m_projectileSystem->Simulate(timeStep);
+}
+void pragma::physics::PhysXEnvironment::FinalizeStep(float timeStep)
+{
+	for(auto &hController : GetControllers())
+		PhysXController::GetController(*hController).PostSimulate(timeStep);
+
+	m_lineOfSightService->Update();
+	m_sleepStateTracker->DispatchTransitions();
+	m_simEventCallback->DispatchTriggers();
+	m_projectileSystem->DispatchImpacts();
+	m_impactDamageService->DispatchEvents();
+	m_contactSoundService->DispatchEvents();
+}
+
+void pragma::physics::PhysXEnvironment::BeginAsyncStep(float timeStep, float fixedTimeStep, std::coroutine_handle<> continuation)
+{
+	auto &state = *m_asyncState;
+	state.stepContinuations.push_back(continuation);
+	if(state.stepInFlight)
+		return;
+	// Same substep count as DoStepSimulation
+	auto numSubSteps = (fixedTimeStep > 0.f) ? static_cast<uint32_t>(umath::floor(timeStep / fixedTimeStep)) : 0u;
+	for(auto &hController : GetControllers())
+		PhysXController::GetController(*hController).PreSimulate(timeStep);
+	state.stepInFlight = true;
+	state.stepTimeStep = timeStep;
+	state.stepFixedTimeStep = fixedTimeStep;
+	state.numRemainingSubSteps = numSubSteps;
+	if(numSubSteps == 0) {
+		// Nothing to simulate, the step is finalized right away
+		AdvanceAsyncStep();
+		return;
+	}
+	for(auto &vhc : GetVehicles())
+		PhysXVehicle::GetVehicle(*vhc).Simulate(fixedTimeStep);
+	BeginSubStep(fixedTimeStep);
+}
+void pragma::physics::PhysXEnvironment::AdvanceAsyncStep()
+{
+	auto &state = *m_asyncState;
+	if(state.numRemainingSubSteps > 0) {
+		m_scene->checkResults(true);
+		EndSubStep(state.stepFixedTimeStep);
+		if(--state.numRemainingSubSteps > 0) {
+			for(auto &vhc : GetVehicles())
+				PhysXVehicle::GetVehicle(*vhc).Simulate(state.stepFixedTimeStep);
+			BeginSubStep(state.stepFixedTimeStep);
+			return;
+		}
+		SceneWriteScope lock {*this};
+		CommitSceneQueryUpdates();
+	}
+	state.stepInFlight = false;
+	FinalizeStep(state.stepTimeStep);
+	for(auto handle : state.stepContinuations)
+		state.executor.Post(handle);
+	state.stepContinuations.clear();
+}
+void pragma::physics::PhysXEnvironment::CompleteAsyncStep()
+{
+	auto &state = *m_asyncState;
+	while(state.stepInFlight)
+		AdvanceAsyncStep();
+}
+void pragma::physics::PhysXEnvironment::PollAsync()
+{
+	auto &state = *m_asyncState;
+	// Only one substep is advanced per call, so PollAsync never blocks on the simulation
+	if(state.stepInFlight && m_scene->checkResults(false))
+		AdvanceAsyncStep();
+	DispatchAsyncQueries();
+	// Without a step in flight the game thread may modify the scene as soon as we return
+	if(state.stepInFlight == false)
+		WaitForAsyncQueries();
+	state.executor.RunPending();
+}
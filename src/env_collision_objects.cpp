@@ -55,4 +55,20 @@ util::TSharedHandle<pragma::physics::IRigidBody> pragma::physics::PhysXEnvironme
 	return rigidBody;
 }
 util::TSharedHandle<pragma::physics::ISoftBody> pragma::physics::PhysXEnvironment::CreateSoftBody(const PhysSoftBodyInfo &info, float mass, const std::vector<Vector3> &verts, const std::vector<uint16_t> &indices, std::vector<uint16_t> &indexTranslations) { return nullptr; }
-util::TSharedHandle<pragma::physics::IGhostObject> pragma::physics::PhysXEnvironment::CreateGhostObject(IShape &shape) { return nullptr; }
+util::TSharedHandle<pragma::physics::IGhostObject> pragma::physics::PhysXEnvironment::CreateGhostObject(IShape &shape)
+{
+	if(shape.IsValid() == false)
+		return nullptr;
+	physx::PxTransform t {physx::PxVec3 {0.f, 0.f, 0.f}, physx::PxQuat {1.f}};
+	auto *pRigidDynamic = GetPhysics().createRigidDynamic(t);
+	if(pRigidDynamic == nullptr)
+		return nullptr;
+	// Ghost objects are moved by the game, never by the simulation
+	pRigidDynamic->setRigidBodyFlag(physx::PxRigidBodyFlag::eKINEMATIC, true);
+	auto ghostObj = CreateSharedHandle<PhysXGhostObject>(*this, px_create_unique_ptr<physx::PxActor>(pRigidDynamic), shape);
+	ghostObj->SetCollisionShape(&shape);
+
+	InitializeCollisionObject(*ghostObj);
+	AddCollisionObject(*ghostObj);
+	return util::shared_handle_cast<PhysXGhostObject, IGhostObject>(ghostObj);
+}
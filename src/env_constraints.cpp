@@ -9,6 +9,7 @@
 
 util::TSharedHandle<pragma::physics::IFixedConstraint> pragma::physics::PhysXEnvironment::CreateFixedConstraint(IRigidBody &a, const Vector3 &pivotA, const Quat &rotA, IRigidBody &b, const Vector3 &pivotB, const Quat &rotB)
 {
+	SceneWriteScope lock {*this};
 	physx::PxTransform tA {uvec::create_px(pivotA), uquat::create_px(rotA)};
 	physx::PxTransform tB {uvec::create_px(pivotB), uquat::create_px(rotB)};
 	auto fixedJoint = px_create_unique_ptr<physx::PxJoint>(physx::PxFixedJointCreate(GetPhysics(), &ToBtType(a).GetInternalObject(), tA, &ToBtType(b).GetInternalObject(), tB));
@@ -18,6 +19,7 @@ util::TSharedHandle<pragma::physics::IFixedConstraint> pragma::physics::PhysXEnv
 }
 util::TSharedHandle<pragma::physics::IBallSocketConstraint> pragma::physics::PhysXEnvironment::CreateBallSocketConstraint(IRigidBody &a, const Vector3 &pivotA, IRigidBody &b, const Vector3 &pivotB)
 {
+	SceneWriteScope lock {*this};
 	physx::PxTransform tA {uvec::create_px(pivotA)};
 	physx::PxTransform tB {uvec::create_px(pivotB)};
 	auto sphericalJoint = px_create_unique_ptr<physx::PxJoint>(physx::PxSphericalJointCreate(GetPhysics(), &ToBtType(a).GetInternalObject(), tA, &ToBtType(b).GetInternalObject(), tB));
@@ -27,6 +29,7 @@ util::TSharedHandle<pragma::physics::IBallSocketConstraint> pragma::physics::Phy
 }
 util::TSharedHandle<pragma::physics::IHingeConstraint> pragma::physics::PhysXEnvironment::CreateHingeConstraint(IRigidBody &a, const Vector3 &pivotA, IRigidBody &b, const Vector3 &pivotB, const Vector3 &axis)
 {
+	SceneWriteScope lock {*this};
 	auto rot = uquat::create(axis, umath::deg_to_rad(90.f));
 	constexpr Quat rot90DegPitch {0.70710676908493, 0.70710676908493, 0, 0};
 	rot = rot90DegPitch * rot;
@@ -40,6 +43,7 @@ util::TSharedHandle<pragma::physics::IHingeConstraint> pragma::physics::PhysXEnv
 }
 util::TSharedHandle<pragma::physics::ISliderConstraint> pragma::physics::PhysXEnvironment::CreateSliderConstraint(IRigidBody &a, const Vector3 &pivotA, const Quat &rotA, IRigidBody &b, const Vector3 &pivotB, const Quat &rotB)
 {
+	SceneWriteScope lock {*this};
 	physx::PxTransform tA {uvec::create_px(pivotA), uquat::create_px(rotA)};
 	physx::PxTransform tB {uvec::create_px(pivotB), uquat::create_px(rotB)};
 	auto prismaticJoint = px_create_unique_ptr<physx::PxJoint>(physx::PxPrismaticJointCreate(GetPhysics(), &ToBtType(a).GetInternalObject(), tA, &ToBtType(b).GetInternalObject(), tB));
@@ -49,6 +53,7 @@ util::TSharedHandle<pragma::physics::ISliderConstraint> pragma::physics::PhysXEn
 }
 util::TSharedHandle<pragma::physics::IConeTwistConstraint> pragma::physics::PhysXEnvironment::CreateConeTwistConstraint(IRigidBody &a, const Vector3 &pivotA, const Quat &rotA, IRigidBody &b, const Vector3 &pivotB, const Quat &rotB)
 {
+	SceneWriteScope lock {*this};
 	physx::PxTransform tA {uvec::create_px(pivotA), uquat::create_px(rotA)};
 	physx::PxTransform tB {uvec::create_px(pivotB), uquat::create_px(rotB)};
 	auto sphericalJoint = px_create_unique_ptr<physx::PxJoint>(physx::PxD6JointCreate(GetPhysics(), &ToBtType(a).GetInternalObject(), tA, &ToBtType(b).GetInternalObject(), tB));
@@ -65,6 +70,7 @@ util::TSharedHandle<pragma::physics::IConeTwistConstraint> pragma::physics::Phys
 }
 util::TSharedHandle<pragma::physics::IDoFConstraint> pragma::physics::PhysXEnvironment::CreateDoFConstraint(IRigidBody &a, const Vector3 &pivotA, const Quat &rotA, IRigidBody &b, const Vector3 &pivotB, const Quat &rotB)
 {
+	SceneWriteScope lock {*this};
 	physx::PxTransform tA {uvec::create_px(pivotA), uquat::create_px(rotA)};
 	physx::PxTransform tB {uvec::create_px(pivotB), uquat::create_px(rotB)};
 	auto d6Joint = px_create_unique_ptr<physx::PxJoint>(physx::PxD6JointCreate(GetPhysics(), &ToBtType(a).GetInternalObject(), tA, &ToBtType(b).GetInternalObject(), tB));
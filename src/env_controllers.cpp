@@ -68,6 +68,7 @@ util::TSharedHandle<pragma::physics::IController> pragma::physics::PhysXEnvironm
 
 util::TSharedHandle<pragma::physics::IController> pragma::physics::PhysXEnvironment::CreateCapsuleController(float halfWidth, float halfHeight, float stepHeight, umath::Degree slopeLimit, const umath::Transform &startTransform)
 {
+	SceneWriteScope lock {*this};
 	physx::PxCapsuleControllerDesc capsuleDesc {};
 	InitializeControllerDesc(capsuleDesc, halfHeight, stepHeight, startTransform);
 	capsuleDesc.climbingMode = physx::PxCapsuleClimbingMode::eEASY;
@@ -88,6 +89,7 @@ util::TSharedHandle<pragma::physics::IController> pragma::physics::PhysXEnvironm
 }
 util::TSharedHandle<pragma::physics::IController> pragma::physics::PhysXEnvironment::CreateBoxController(const Vector3 &halfExtents, float stepHeight, umath::Degree slopeLimit, const umath::Transform &startTransform)
 {
+	SceneWriteScope lock {*this};
 	physx::PxBoxControllerDesc boxDesc {};
 	InitializeControllerDesc(boxDesc, halfExtents.y, stepHeight, startTransform);
 	boxDesc.halfHeight = halfExtents.y;
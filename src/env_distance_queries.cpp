@@ -0,0 +1,118 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/environment.hpp"
+#include "pr_physx/collision_object.hpp"
+#include "pr_physx/task.hpp"
+#include <array>
+#include <limits>
+
+static physx::PxQueryFilterData get_distance_query_filter_data(CollisionMask mask)
+{
+	// All shapes within range are candidates, so there's no need for blocking hits
+	physx::PxQueryFilterData queryFilterData {physx::PxQueryFlag::eSTATIC | physx::PxQueryFlag::eDYNAMIC | physx::PxQueryFlag::eNO_BLOCK};
+	pragma::physics::PhysXEnvironment::ApplyQueryCollisionMask(mask, queryFilterData);
+	return queryFilterData;
+}
+
+namespace {
+	// Evaluates the candidate shapes in batches whenever the touch buffer is full, so the number of
+	// candidates is not limited by the size of the buffer
+	class ClosestPointCallback : public physx::PxOverlapCallback {
+	  public:
+		ClosestPointCallback(const physx::PxVec3 &point, float maxDistance) : physx::PxOverlapCallback {m_touchBuffer.data(), static_cast<physx::PxU32>(m_touchBuffer.size())}, closestDistanceSqr {maxDistance * maxDistance}, m_point {point} {}
+		virtual physx::PxAgain processTouches(const physx::PxOverlapHit *buffer, physx::PxU32 nbHits) override
+		{
+			for(auto i = decltype(nbHits) {0u}; i < nbHits; ++i) {
+				auto &touchHit = buffer[i];
+				auto &geometry = touchHit.shape->getGeometry();
+				switch(geometry.getType()) {
+				case physx::PxGeometryType::eSPHERE:
+				case physx::PxGeometryType::eCAPSULE:
+				case physx::PxGeometryType::eBOX:
+				case physx::PxGeometryType::eCONVEXMESH:
+				case physx::PxGeometryType::eTRIANGLEMESH:
+					break;
+				default:
+					continue; // Not supported by pointDistance
+				}
+				physx::PxVec3 shapeClosestPoint {};
+				auto distanceSqr = physx::PxGeometryQuery::pointDistance(m_point, geometry, physx::PxShapeExt::getGlobalPose(*touchHit.shape, *touchHit.actor), &shapeClosestPoint);
+				if(distanceSqr < 0.f || distanceSqr > closestDistanceSqr)
+					continue;
+				closestDistanceSqr = distanceSqr;
+				// The buffer is re-used for the next batch, so the actor has to be stored instead of the hit
+				closestActor = touchHit.actor;
+				if(distanceSqr == 0.f) {
+					// Point is inside of the geometry, no other shape can be closer
+					closestPoint = m_point;
+					return false;
+				}
+				closestPoint = shapeClosestPoint;
+			}
+			return true;
+		}
+		virtual void finalizeQuery() override
+		{
+			// The last batch may not have filled up the buffer. Evaluating a candidate twice does not change the result.
+			if(closestDistanceSqr == 0.f)
+				return;
+			processTouches(touches, nbTouches);
+			nbTouches = 0;
+		}
+
+		float closestDistanceSqr = 0.f;
+		const physx::PxRigidActor *closestActor = nullptr;
+		physx::PxVec3 closestPoint {};
+	  private:
+		std::array<physx::PxOverlapHit, 32> m_touchBuffer;
+		physx::PxVec3 m_point;
+	};
+};
+
+bool pragma::physics::PhysXEnvironment::FindClosestPoint(const Vector3 &point, float maxDistance, const physx::PxQueryFilterData &queryFilterData, ClosestPointResult &outResult) const
+{
+	// Overlap pre-pass to find all candidate shapes within range, followed by the exact distance test for each candidate
+	auto pxPoint = ToPhysXVector(point);
+	auto pxMaxDistance = static_cast<float>(ToPhysXLength(maxDistance));
+	if(pxMaxDistance <= 0.f)
+		return false;
+	ClosestPointCallback callback {pxPoint, pxMaxDistance};
+	m_scene->overlap(physx::PxSphereGeometry {pxMaxDistance}, physx::PxTransform {pxPoint}, callback, queryFilterData);
+	if(callback.closestActor == nullptr)
+		return false;
+	outResult.distance = FromPhysXLength(physx::PxSqrt(callback.closestDistanceSqr));
+	outResult.closestPoint = FromPhysXVector(callback.closestPoint);
+	auto *colObj = GetCollisionObject(*callback.closestActor);
+	outResult.collisionObject = colObj ? util::weak_shared_handle_cast<IBase, ICollisionObject>(colObj->GetHandle()) : util::TWeakSharedHandle<ICollisionObject> {};
+	return true;
+}
+
+bool pragma::physics::PhysXEnvironment::FindClosestPoint(const Vector3 &point, float maxDistance, ClosestPointResult &outResult, CollisionMask mask) const
+{
+	outResult = {};
+	auto queryFilterData = get_distance_query_filter_data(mask);
+	SceneReadScope lock {*this};
+	return FindClosestPoint(point, maxDistance, queryFilterData, outResult);
+}
+float pragma::physics::PhysXEnvironment::GetDistance(const Vector3 &point, float maxDistance, CollisionMask mask) const
+{
+	ClosestPointResult result {};
+	FindClosestPoint(point, maxDistance, result, mask);
+	return result.distance;
+}
+void pragma::physics::PhysXEnvironment::FindClosestPoints(const std::vector<Vector3> &points, float maxDistance, std::vector<ClosestPointResult> &outResults, CollisionMask mask) const
+{
+	outResults.clear();
+	outResults.resize(points.size());
+	auto queryFilterData = get_distance_query_filter_data(mask);
+	ParallelFor(points.size(), 32, [this, &points, maxDistance, &queryFilterData, &outResults](uint32_t start, uint32_t end) {
+		// Every worker thread has to hold the read lock itself
+		SceneReadScope lock {*this};
+		for(auto i = start; i < end; ++i)
+			FindClosestPoint(points[i], maxDistance, queryFilterData, outResults[i]);
+	});
+}
+
+void pragma::physics::PhysXEnvironment::ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)> &fn) const { px_parallel_for(*m_cpuDispatcher, count, batchSize, fn); }
@@ -0,0 +1,199 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/environment.hpp"
+#include "pr_physx/collision_object.hpp"
+#include <array>
+#include <algorithm>
+#include <vector>
+
+namespace {
+	// Ignores the observer, as well as the target when testing the line of sight
+	class PerceptionFilterCallback : public physx::PxQueryFilterCallback {
+	  public:
+		PerceptionFilterCallback(const physx::PxActor *observer) : m_observer {observer} {}
+		void SetTarget(const physx::PxActor *target) { m_target = target; }
+		virtual physx::PxQueryHitType::Enum preFilter(const physx::PxFilterData &filterData, const physx::PxShape *shape, const physx::PxRigidActor *actor, physx::PxHitFlags &queryFlags) override
+		{
+			return (actor == m_observer || actor == m_target) ? physx::PxQueryHitType::eNONE : physx::PxQueryHitType::eBLOCK;
+		}
+		virtual physx::PxQueryHitType::Enum postFilter(const physx::PxFilterData &filterData, const physx::PxQueryHit &hit, const physx::PxShape *shape, const physx::PxRigidActor *actor) override { return physx::PxQueryHitType::eBLOCK; }
+	  private:
+		const physx::PxActor *m_observer = nullptr;
+		const physx::PxActor *m_target = nullptr;
+	};
+
+	struct PerceptionCandidate {
+		const physx::PxRigidActor *actor = nullptr;
+		// Center of the bounds of the shape that was hit, relative to the eye
+		physx::PxVec3 center;
+	};
+	// Collects the broadphase candidates in batches whenever the touch buffer is full, so the number of candidates
+	// is not limited by the size of the buffer
+	class PerceptionCandidateCallback : public physx::PxOverlapCallback {
+	  public:
+		PerceptionCandidateCallback(const physx::PxVec3 &eye, std::vector<PerceptionCandidate> &candidates) : physx::PxOverlapCallback {m_touchBuffer.data(), static_cast<physx::PxU32>(m_touchBuffer.size())}, m_eye {eye}, m_candidates {candidates} {}
+		virtual physx::PxAgain processTouches(const physx::PxOverlapHit *buffer, physx::PxU32 nbHits) override
+		{
+			for(auto i = decltype(nbHits) {0u}; i < nbHits; ++i) {
+				auto &touchHit = buffer[i];
+				m_candidates.push_back({touchHit.actor, physx::PxShapeExt::getWorldBounds(*touchHit.shape, *touchHit.actor).getCenter() - m_eye});
+			}
+			return true;
+		}
+		virtual void finalizeQuery() override
+		{
+			// Touches of the last batch that didn't fill up the buffer
+			processTouches(touches, nbTouches);
+			nbTouches = 0;
+		}
+	  private:
+		std::array<physx::PxOverlapHit, 128> m_touchBuffer;
+		physx::PxVec3 m_eye;
+		std::vector<PerceptionCandidate> &m_candidates;
+	};
+};
+
+static physx::PxQueryFilterData get_perception_query_filter_data(CollisionMask mask, physx::PxQueryFlags flags)
+{
+	physx::PxQueryFilterData queryFilterData {physx::PxQueryFlag::eSTATIC | physx::PxQueryFlag::eDYNAMIC | physx::PxQueryFlag::ePREFILTER | flags};
+	pragma::physics::PhysXEnvironment::ApplyQueryCollisionMask(mask, queryFilterData);
+	return queryFilterData;
+}
+// Returns a query cache for the last known occluder, if it still exists
+static bool get_occluder_cache(const pragma::physics::PhysXEnvironment::PerceptionCache::Occluder &occluder, physx::PxQueryCache &outCache)
+{
+	auto *colObj = occluder.collisionObject.Get();
+	if(colObj == nullptr || colObj->IsRigid() == false)
+		return false;
+	auto &body = static_cast<const pragma::physics::PhysXRigidBody &>(pragma::physics::PhysXCollisionObject::GetCollisionObject(*colObj));
+	auto &actorShapes = body.GetActorShapeCollection().GetActorShapes();
+	auto it = std::find_if(actorShapes.begin(), actorShapes.end(), [&occluder](const std::unique_ptr<pragma::physics::PhysXActorShape> &actorShape) { return &actorShape->GetActorShape() == occluder.shape; });
+	if(it == actorShapes.end())
+		return false;
+	outCache = physx::PxQueryCache {const_cast<physx::PxShape *>(occluder.shape), &body.GetInternalObject()};
+	return true;
+}
+
+void pragma::physics::PhysXEnvironment::QueryPerception(const PerceptionQuery &query, std::vector<PerceivedTarget> &outTargets) const
+{
+	auto eye = ToPhysXVector(query.eyePosition);
+	auto range = static_cast<float>(ToPhysXLength(query.range));
+	if(range <= 0.f)
+		return;
+	if(query.cache) {
+		for(auto it = query.cache->occluders.begin(); it != query.cache->occluders.end();) {
+			if(it->second.target.IsExpired())
+				it = query.cache->occluders.erase(it);
+			else
+				++it;
+		}
+	}
+	// The observer may have been removed from the world, in which case there is no actor to ignore
+	auto *observer = query.observer.Get();
+	const physx::PxActor *observerActor = nullptr;
+	if(observer) {
+		auto &observerObj = PhysXCollisionObject::GetCollisionObject(*observer);
+		if(observerObj.HasInternalObject())
+			observerActor = &observerObj.GetInternalObject();
+	}
+	PerceptionFilterCallback filter {observerActor};
+
+	SceneReadScope lock {*this};
+
+	// Broadphase candidates within range. The buffers are re-used by all queries of the same thread.
+	static thread_local std::vector<PerceptionCandidate> touches;
+	touches.clear();
+	PerceptionCandidateCallback hit {eye, touches};
+	m_scene->overlap(physx::PxSphereGeometry {range}, physx::PxTransform {eye}, hit, get_perception_query_filter_data(query.targetMask, physx::PxQueryFlag::eNO_BLOCK), &filter);
+	if(touches.empty())
+		return;
+
+	// Every actor is only tested once, at the center of the bounds of the first shape that was hit
+	std::stable_sort(touches.begin(), touches.end(), [](const PerceptionCandidate &a, const PerceptionCandidate &b) { return a.actor < b.actor; });
+	touches.erase(std::unique(touches.begin(), touches.end(), [](const PerceptionCandidate &a, const PerceptionCandidate &b) { return a.actor == b.actor; }), touches.end());
+	static thread_local std::vector<const physx::PxRigidActor *> candidates;
+	static thread_local std::vector<float> x;
+	static thread_local std::vector<float> y;
+	static thread_local std::vector<float> z;
+	static thread_local std::vector<uint8_t> inCone;
+	auto numCandidates = static_cast<uint32_t>(touches.size());
+	candidates.resize(numCandidates);
+	x.resize(numCandidates);
+	y.resize(numCandidates);
+	z.resize(numCandidates);
+	inCone.resize(numCandidates);
+	for(auto i = decltype(numCandidates) {0u}; i < numCandidates; ++i) {
+		auto &touch = touches[i];
+		candidates[i] = touch.actor;
+		x[i] = touch.center.x;
+		y[i] = touch.center.y;
+		z[i] = touch.center.z;
+	}
+
+	// Angular culling. The candidates are stored as separate coordinate arrays, so this loop can be vectorized by the compiler.
+	auto forward = ToPhysXNormal(query.eyeDirection).getNormalized();
+	auto cosHalfFov = umath::cos(umath::deg_to_rad(query.fov * 0.5f));
+	auto cosHalfFovSqr = cosHalfFov * cosHalfFov;
+	auto wideFov = (cosHalfFov < 0.f);
+	for(auto i = decltype(numCandidates) {0u}; i < numCandidates; ++i) {
+		// Equivalent to d /|v| >= cos(fov /2), without the square root
+		auto d = x[i] * forward.x + y[i] * forward.y + z[i] * forward.z;
+		auto lenSqr = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+		auto withinAngle = wideFov ? (d >= 0.f || d * d <= cosHalfFovSqr * lenSqr) : (d >= 0.f && d * d >= cosHalfFovSqr * lenSqr);
+		inCone[i] = withinAngle || lenSqr == 0.f;
+	}
+
+	// Line of sight
+	auto losFilterData = get_perception_query_filter_data(query.occluderMask, physx::PxQueryFlag::eANY_HIT);
+	for(auto i = decltype(numCandidates) {0u}; i < numCandidates; ++i) {
+		if(inCone[i] == 0)
+			continue;
+		auto *target = candidates[i];
+		auto *colObj = GetCollisionObject(*target);
+		if(colObj == nullptr)
+			continue;
+		physx::PxVec3 dir {x[i], y[i], z[i]};
+		auto distance = dir.magnitude();
+		if(distance > 0.f) {
+			dir /= distance;
+			filter.SetTarget(target);
+			physx::PxQueryCache cache {};
+			auto *pCache = &cache;
+			if(query.cache == nullptr)
+				pCache = nullptr;
+			else {
+				auto it = query.cache->occluders.find(colObj);
+				if(it == query.cache->occluders.end() || it->second.target.Get() != colObj || get_occluder_cache(it->second, cache) == false)
+					pCache = nullptr;
+			}
+			physx::PxRaycastBuffer losHit {};
+			auto occluded = m_scene->raycast(eye, dir, distance, losHit, physx::PxHitFlag::eMESH_ANY, losFilterData, &filter, pCache) && losHit.hasBlock;
+			if(query.cache) {
+				if(occluded) {
+					auto *occluder = GetCollisionObject(*losHit.block.actor);
+					if(occluder)
+						query.cache->occluders[colObj] = {util::weak_shared_handle_cast<IBase, ICollisionObject>(colObj->GetHandle()), util::weak_shared_handle_cast<IBase, ICollisionObject>(occluder->GetHandle()), losHit.block.shape};
+				}
+				else
+					query.cache->occluders.erase(colObj);
+			}
+			if(occluded)
+				continue;
+		}
+		outTargets.push_back({util::weak_shared_handle_cast<IBase, ICollisionObject>(colObj->GetHandle()), static_cast<float>(FromPhysXLength(distance))});
+	}
+}
+
+void pragma::physics::PhysXEnvironment::QueryPerception(const std::vector<PerceptionQuery> &queries, std::vector<std::vector<PerceivedTarget>> &outResults) const
+{
+	outResults.clear();
+	outResults.resize(queries.size());
+	ParallelFor(queries.size(), 4, [this, &queries, &outResults](uint32_t start, uint32_t end) {
+		// Every worker thread has to hold the read lock itself
+		SceneReadScope lock {*this};
+		for(auto i = start; i < end; ++i)
+			QueryPerception(queries[i], outResults[i]);
+	});
+}
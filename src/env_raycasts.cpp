@@ -4,11 +4,16 @@
 
 #include <cinttypes>
 #include <limits>
+#include <algorithm>
+#include <unordered_set>
 #include <pragma/entities/entity_component_manager.hpp>
 #include "pr_physx/environment.hpp"
 #include "pr_physx/collision_object.hpp"
 #include "pr_physx/raycast.hpp"
 #include "pr_physx/shape.hpp"
+#include "pr_physx/material.hpp"
+#include "pr_physx/query_profiler.hpp"
+#include "pr_physx/pose_history.hpp"
 #include <pragma/entities/baseentity.h>
 #include <pragma/physics/raytraces.h>
 
@@ -78,10 +83,9 @@ void pragma::physics::PhysXEnvironment::InitializeRayCastResult(const TraceData
 	outResult.startPosition = data.GetSourceOrigin();
 }
 
-static std::unique_ptr<pragma::physics::RayCastFilterCallback> get_raycast_filter(const pragma::physics::PhysXEnvironment &env, const TraceData &data, physx::PxHitFlags &hitFlags, physx::PxQueryFilterData &queryFilterData)
+static void translate_raycast_flags(RayCastFlags flags, physx::PxHitFlags &hitFlags, physx::PxQueryFlags &queryFlags)
 {
-	auto flags = data.GetFlags();
-	physx::PxQueryFlags queryFlags = physx::PxQueryFlag::eDYNAMIC | physx::PxQueryFlag::eSTATIC;
+	queryFlags = physx::PxQueryFlag::eDYNAMIC | physx::PxQueryFlag::eSTATIC;
 	hitFlags = static_cast<physx::PxHitFlags>(0);
 	if(umath::is_flag_set(flags, RayCastFlags::ReportHitPosition))
 		hitFlags |= physx::PxHitFlag::ePOSITION;
@@ -92,7 +96,8 @@ static std::unique_ptr<pragma::physics::RayCastFilterCallback> get_raycast_filte
 	if(umath::is_flag_set(flags, RayCastFlags::ReportAllResults))
 		hitFlags |= physx::PxHitFlag::eMESH_MULTIPLE;
 	if(umath::is_flag_set(flags, RayCastFlags::ReportAnyResult)) {
-		queryFlags = physx::PxQueryFlag::eANY_HIT;
+		// Has to be added to the static/dynamic flags, without them the query wouldn't test any actors at all
+		queryFlags |= physx::PxQueryFlag::eANY_HIT;
 		hitFlags |= physx::PxHitFlag::eMESH_ANY;
 	}
 	if(umath::is_flag_set(flags, RayCastFlags::ReportBackFaceHits))
@@ -104,6 +109,12 @@ static std::unique_ptr<pragma::physics::RayCastFilterCallback> get_raycast_filte
 		queryFlags &= ~physx::PxQueryFlag::eDYNAMIC;
 	if(umath::is_flag_set(flags, RayCastFlags::IgnoreStatic))
 		queryFlags &= ~physx::PxQueryFlag::eSTATIC;
+}
+static std::unique_ptr<pragma::physics::RayCastFilterCallback> get_raycast_filter(const pragma::physics::PhysXEnvironment &env, const TraceData &data, physx::PxHitFlags &hitFlags, physx::PxQueryFilterData &queryFilterData)
+{
+	auto flags = data.GetFlags();
+	physx::PxQueryFlags queryFlags;
+	translate_raycast_flags(flags, hitFlags, queryFlags);
 
 	auto &filter = data.GetFilter();
 	std::unique_ptr<pragma::physics::RayCastFilterCallback> pxFilter = nullptr;
@@ -115,52 +126,286 @@ static std::unique_ptr<pragma::physics::RayCastFilterCallback> get_raycast_filte
 			queryFlags |= physx::PxQueryFlag::ePOSTFILTER;
 	}
 	queryFilterData = physx::PxQueryFilterData {queryFlags};
+	pragma::physics::PhysXEnvironment::ApplyQueryCollisionMask(data.GetCollisionFilterMask(), queryFilterData);
 	return pxFilter;
 }
+// Emulates the filtering the scene would apply to the shape before the exact intersection test
+static physx::PxQueryHitType::Enum prefilter_query_shape(const physx::PxQueryFilterData &queryFilterData, pragma::physics::RayCastFilterCallback *filter, const physx::PxRigidActor &actor, const physx::PxShape &shape, physx::PxHitFlags &hitFlags)
+{
+	if(shape.getFlags().isSet(physx::PxShapeFlag::eSCENE_QUERY_SHAPE) == false)
+		return physx::PxQueryHitType::eNONE;
+	auto requiredFlag = (actor.getType() == physx::PxActorType::eRIGID_STATIC) ? physx::PxQueryFlag::eSTATIC : physx::PxQueryFlag::eDYNAMIC;
+	if(queryFilterData.flags.isSet(requiredFlag) == false)
+		return physx::PxQueryHitType::eNONE;
+	auto &filterData = queryFilterData.data;
+	if(filterData.word0 != 0 || filterData.word1 != 0 || filterData.word2 != 0 || filterData.word3 != 0) {
+		auto shapeFilterData = shape.getQueryFilterData();
+		if(((filterData.word0 & shapeFilterData.word0) | (filterData.word1 & shapeFilterData.word1) | (filterData.word2 & shapeFilterData.word2) | (filterData.word3 & shapeFilterData.word3)) == 0)
+			return physx::PxQueryHitType::eNONE;
+	}
+	if(filter && queryFilterData.flags.isSet(physx::PxQueryFlag::ePREFILTER))
+		return filter->preFilter(queryFilterData.data, &shape, &actor, hitFlags);
+	return physx::PxQueryHitType::eBLOCK;
+}
+static RayCastHitType to_raycast_hit_type(physx::PxQueryHitType::Enum hitType)
+{
+	switch(hitType) {
+	case physx::PxQueryHitType::eTOUCH:
+		return RayCastHitType::Touch;
+	case physx::PxQueryHitType::eBLOCK:
+		return RayCastHitType::Block;
+	}
+	return RayCastHitType::None;
+}
+template<class THit>
+static bool postfilter_query_hit(const physx::PxQueryFilterData &queryFilterData, pragma::physics::RayCastFilterCallback *filter, THit &hit, RayCastHitType &inOutHitType)
+{
+	if(filter && queryFilterData.flags.isSet(physx::PxQueryFlag::ePOSTFILTER))
+		inOutHitType = to_raycast_hit_type(filter->postFilter(queryFilterData.data, hit, hit.shape, hit.actor));
+	return inOutHitType != RayCastHitType::None;
+}
+static float get_hit_distance(const physx::PxLocationHit &hit) { return hit.distance; }
+static float get_hit_distance(const physx::PxOverlapHit &hit) { return 0.f; }
+
+template<class THit>
+Bool pragma::physics::PhysXEnvironment::InitializeQueryResults(const TraceData &data, float distance, std::vector<std::pair<THit, RayCastHitType>> &hits, std::vector<TraceResult> *optOutResults) const
+{
+	// Same semantics as the scene queries: The closest blocking hit, as well as all touching hits in front of it
+	auto itBlock = hits.end();
+	for(auto it = hits.begin(); it != hits.end(); ++it) {
+		if(it->second == RayCastHitType::Block && (itBlock == hits.end() || get_hit_distance(it->first) < get_hit_distance(itBlock->first)))
+			itBlock = it;
+	}
+	auto bHitAny = (hits.empty() == false);
+	if(optOutResults == nullptr || bHitAny == false)
+		return bHitAny;
+	auto blockDistance = (itBlock != hits.end()) ? get_hit_distance(itBlock->first) : std::numeric_limits<float>::max();
+	optOutResults->reserve(optOutResults->size() + hits.size() + 1);
+	for(auto &pair : hits) {
+		if(pair.second != RayCastHitType::Touch || get_hit_distance(pair.first) > blockDistance)
+			continue;
+		optOutResults->push_back({});
+		InitializeRayCastResult(data, distance, pair.first, optOutResults->back(), RayCastHitType::Touch);
+	}
+	optOutResults->push_back({});
+	auto &result = optOutResults->back();
+	if(itBlock != hits.end())
+		InitializeRayCastResult(data, distance, itBlock->first, result, RayCastHitType::Block);
+	else
+		InitializeRayCastResult(data, distance, THit {}, result, RayCastHitType::None);
+	return bHitAny;
+}
+
+namespace {
+	struct QueryGeometry {
+		const physx::PxGeometry *geometry = nullptr;
+		physx::PxTransform localPose {physx::PxIdentity};
+	};
+};
+static bool is_convex_geometry(const physx::PxGeometry &geometry)
+{
+	switch(geometry.getType()) {
+	case physx::PxGeometryType::eSPHERE:
+	case physx::PxGeometryType::eCAPSULE:
+	case physx::PxGeometryType::eBOX:
+	case physx::PxGeometryType::eCONVEXMESH:
+		return true;
+	}
+	return false;
+}
+// PxGeometryQuery::overlap only supports planes and heightfields in combination with convex geometry
+static bool is_overlap_supported(const physx::PxGeometry &geometry0, const physx::PxGeometry &geometry1)
+{
+	if(is_convex_geometry(geometry0) || is_convex_geometry(geometry1))
+		return true;
+	auto isSupported = [](physx::PxGeometryType::Enum type) { return type != physx::PxGeometryType::ePLANE && type != physx::PxGeometryType::eHEIGHTFIELD; };
+	return isSupported(geometry0.getType()) && isSupported(geometry1.getType());
+}
+// Most query shapes consist of a single geometry, so no heap allocation is required in most cases
+using QueryGeometries = physx::PxInlineArray<QueryGeometry, 4>;
+static void get_query_geometries(const pragma::physics::IShape &shape, QueryGeometries &outGeometries, bool convexOnly = false)
+{
+	auto &pxShape = pragma::physics::PhysXShape::GetShape(shape);
+	if(shape.IsCompoundShape() == false) {
+		auto &geometryHolder = pxShape.GetInternalObject();
+		if(geometryHolder.getType() != physx::PxGeometryType::eINVALID && (convexOnly == false || is_convex_geometry(geometryHolder.any())))
+			outGeometries.pushBack({&geometryHolder.any()});
+		return;
+	}
+	auto &compoundShape = static_cast<const pragma::physics::PhysXCompoundShape &>(pxShape);
+	auto &subShapes = compoundShape.GetShapes();
+	outGeometries.reserve(subShapes.size());
+	auto parentPose = compoundShape.GetLocalPose();
+	for(auto &shapeInfo : subShapes) {
+		if(shapeInfo.shape->IsCompoundShape() == true)
+			continue; // Compound shapes of compound shapes currently not supported
+		auto &subShape = pragma::physics::PhysXShape::GetShape(*shapeInfo.shape);
+		auto &geometryHolder = subShape.GetInternalObject();
+		if(geometryHolder.getType() == physx::PxGeometryType::eINVALID || (convexOnly && is_convex_geometry(geometryHolder.any()) == false))
+			continue;
+		// Same pose as the one used when the sub-shape is attached to an actor
+		outGeometries.pushBack({&geometryHolder.any(), pragma::physics::PhysXEnvironment::CreatePxTransform(parentPose * shapeInfo.localPose * subShape.GetLocalPose())});
+	}
+}
+template<class THit>
+static void add_query_hit(std::vector<std::pair<THit, RayCastHitType>> &hits, const THit &hit, RayCastHitType hitType)
+{
+	auto it = std::find_if(hits.begin(), hits.end(), [&hit](const std::pair<THit, RayCastHitType> &pair) { return pair.first.shape == hit.shape; });
+	if(it == hits.end()) {
+		hits.push_back({hit, hitType});
+		return;
+	}
+	// The same shape may have been hit by several sub-shapes of a compound query shape, only the closest hit is kept
+	auto distance = get_hit_distance(hit);
+	auto prevDistance = get_hit_distance(it->first);
+	if(distance < prevDistance)
+		*it = {hit, hitType};
+	else if(distance == prevDistance && hitType == RayCastHitType::Block)
+		it->second = hitType;
+}
+template<class THit, class TBuffer>
+static void add_query_hits(std::vector<std::pair<THit, RayCastHitType>> &hits, const TBuffer &buffer)
+{
+	auto numTouches = buffer.getNbTouches();
+	for(auto i = decltype(numTouches) {0u}; i < numTouches; ++i)
+		add_query_hit(hits, buffer.getTouch(i), RayCastHitType::Touch);
+	if(buffer.hasBlock)
+		add_query_hit(hits, buffer.block, RayCastHitType::Block);
+}
+static void overlap_convex_geometry(const physx::PxScene &scene, const physx::PxGeometry &geometry, const physx::PxTransform &pose, const physx::PxQueryFilterData &queryFilterData, pragma::physics::RayCastFilterCallback *filter,
+  std::vector<std::pair<physx::PxOverlapHit, RayCastHitType>> &hits)
+{
+	physx::PxOverlapBuffer hit {};
+	std::array<physx::PxOverlapHit, 32> touchingHits; // Arbitrary maximum number of touches
+	hit.touches = touchingHits.data();
+	hit.maxNbTouches = touchingHits.size();
+	if(scene.overlap(geometry, pose, hit, queryFilterData, filter) == false)
+		return;
+	pragma::physics::PhysXSceneQueryProfiler::RecordTouches(hit);
+	add_query_hits(hits, hit);
+}
+namespace {
+	// Runs the exact overlap test for the candidate shapes in batches whenever the touch buffer is full,
+	// so the number of candidates is not limited by the size of the buffer
+	class OverlapCandidateCallback : public physx::PxOverlapCallback {
+	  public:
+		OverlapCandidateCallback(const physx::PxGeometry &geometry, const physx::PxTransform &pose, const physx::PxQueryFilterData &queryFilterData, pragma::physics::RayCastFilterCallback *filter,
+		  std::vector<std::pair<physx::PxOverlapHit, RayCastHitType>> &hits)
+		    : physx::PxOverlapCallback {m_candidateBuffer.data(), static_cast<physx::PxU32>(m_candidateBuffer.size())}, m_geometry {geometry}, m_pose {pose}, m_queryFilterData {queryFilterData}, m_filter {filter}, m_hits {hits}
+		{
+		}
+		virtual physx::PxAgain processTouches(const physx::PxOverlapHit *buffer, physx::PxU32 nbHits) override
+		{
+			auto anyHit = m_queryFilterData.flags.isSet(physx::PxQueryFlag::eANY_HIT);
+			for(auto i = decltype(nbHits) {0u}; i < nbHits; ++i) {
+				auto hit = buffer[i];
+				auto &otherGeometry = hit.shape->getGeometry();
+				if(is_overlap_supported(m_geometry, otherGeometry) == false)
+					continue;
+				auto hitFlags = static_cast<physx::PxHitFlags>(0);
+				auto hitType = to_raycast_hit_type(prefilter_query_shape(m_queryFilterData, m_filter, *hit.actor, *hit.shape, hitFlags));
+				if(hitType == RayCastHitType::None)
+					continue;
+				if(physx::PxGeometryQuery::overlap(m_geometry, m_pose, otherGeometry, physx::PxShapeExt::getGlobalPose(*hit.shape, *hit.actor)) == false)
+					continue;
+				if(postfilter_query_hit(m_queryFilterData, m_filter, hit, hitType) == false)
+					continue;
+				add_query_hit(m_hits, hit, anyHit ? RayCastHitType::Block : hitType);
+				if(anyHit) {
+					m_done = true;
+					return false;
+				}
+			}
+			return true;
+		}
+		virtual void finalizeQuery() override
+		{
+			// The last batch may not have filled up the buffer. Hits are merged per shape, so evaluating a candidate twice does not change the result.
+			if(m_done)
+				return;
+			processTouches(touches, nbTouches);
+			nbTouches = 0;
+		}
+	  private:
+		std::array<physx::PxOverlapHit, 32> m_candidateBuffer;
+		const physx::PxGeometry &m_geometry;
+		physx::PxTransform m_pose;
+		const physx::PxQueryFilterData &m_queryFilterData;
+		pragma::physics::RayCastFilterCallback *m_filter = nullptr;
+		std::vector<std::pair<physx::PxOverlapHit, RayCastHitType>> &m_hits;
+		bool m_done = false;
+	};
+};
+static void overlap_geometry(const physx::PxScene &scene, const physx::PxGeometry &geometry, const physx::PxTransform &pose, const physx::PxQueryFilterData &queryFilterData, pragma::physics::RayCastFilterCallback *filter,
+  std::vector<std::pair<physx::PxOverlapHit, RayCastHitType>> &hits)
+{
+	if(is_convex_geometry(geometry)) {
+		overlap_convex_geometry(scene, geometry, pose, queryFilterData, filter, hits);
+		return;
+	}
+	// The scene can only be queried with convex geometry. For everything else we collect all candidate shapes
+	// with the bounds of the geometry and run the exact test for each candidate ourselves.
+	physx::PxBounds3 bounds;
+	physx::PxGeometryQuery::computeGeomBounds(bounds, geometry, pose);
+	physx::PxQueryFilterData candidateFilterData {queryFilterData.data, (queryFilterData.flags & (physx::PxQueryFlag::eSTATIC | physx::PxQueryFlag::eDYNAMIC)) | physx::PxQueryFlag::eNO_BLOCK};
+	OverlapCandidateCallback candidates {geometry, pose, queryFilterData, filter, hits};
+	scene.overlap(physx::PxBoxGeometry {bounds.getExtents()}, physx::PxTransform {bounds.getCenter()}, candidates, candidateFilterData);
+}
 Bool pragma::physics::PhysXEnvironment::Overlap(const TraceData &data, std::vector<TraceResult> *optOutResults) const
 {
+	PhysXSceneQueryProfiler::QueryScope profilerScope {m_sceneQueryProfiler.get(), PhysXSceneQueryProfiler::QueryType::Overlap};
 	auto *shape = data.GetShape();
-	if(shape == nullptr || shape->IsConvex() == false)
+	if(shape == nullptr)
 		return false;
-	auto &convexShape = static_cast<const PhysXConvexShape &>(PhysXShape::GetShape(*shape));
-	if(convexShape.m_geometry == nullptr)
+	QueryGeometries queryGeometries {};
+	get_query_geometries(*shape, queryGeometries);
+	if(queryGeometries.empty())
 		return false;
 	physx::PxTransform pose {ToPhysXVector(data.GetSourceOrigin()), ToPhysXRotation(data.GetSourceRotation())};
-	auto origin = ToPhysXVector(data.GetSourceOrigin());
-	auto target = data.GetTargetOrigin();
-	auto distance = uvec::length(target);
-	if(distance == 0.f)
-		return false;
-	auto unitDir = ToPhysXVector(target);
-	unitDir /= distance;
 
 	auto hitFlags = static_cast<physx::PxHitFlags>(0);
 	physx::PxQueryFilterData queryFilterData {};
 	auto pxFilter = get_raycast_filter(*this, data, hitFlags, queryFilterData);
 
-	physx::PxOverlapBuffer hit {};
-	std::array<physx::PxOverlapHit, 32> touchingHits; // Arbitrary maximum number of touches
-	hit.touches = touchingHits.data();
-	hit.maxNbTouches = touchingHits.size();
-	auto bHitAny = m_scene->overlap(*convexShape.m_geometry, pose, hit, queryFilterData, pxFilter.get());
-	if(optOutResults == nullptr || bHitAny == false)
-		return bHitAny;
-	auto numTouches = hit.getNbTouches();
-	optOutResults->reserve(numTouches + 1);
-	for(auto i = decltype(numTouches) {0u}; i < numTouches; ++i) {
-		auto &touchHit = hit.getTouch(i);
+	if(queryGeometries.size() == 1 && is_convex_geometry(*queryGeometries.front().geometry)) {
+		physx::PxOverlapBuffer hit {};
+		std::array<physx::PxOverlapHit, 32> touchingHits; // Arbitrary maximum number of touches
+		hit.touches = touchingHits.data();
+		hit.maxNbTouches = touchingHits.size();
+		SceneReadScope lock {*this};
+		auto bHitAny = m_scene->overlap(*queryGeometries.front().geometry, pose * queryGeometries.front().localPose, hit, queryFilterData, pxFilter.get());
+		PhysXSceneQueryProfiler::RecordTouches(hit);
+		if(optOutResults == nullptr || bHitAny == false)
+			return bHitAny;
+		auto numTouches = hit.getNbTouches();
+		optOutResults->reserve(numTouches + 1);
+		for(auto i = decltype(numTouches) {0u}; i < numTouches; ++i) {
+			auto &touchHit = hit.getTouch(i);
+			optOutResults->push_back({});
+			auto &result = optOutResults->back();
+			InitializeRayCastResult(data, 0.f, touchHit, result, RayCastHitType::Touch);
+		}
 		optOutResults->push_back({});
 		auto &result = optOutResults->back();
-		InitializeRayCastResult(data, distance, touchHit, result, RayCastHitType::Touch);
+		InitializeRayCastResult(data, 0.f, hit.block, result, hit.hasBlock ? RayCastHitType::Block : RayCastHitType::None);
+		return bHitAny;
 	}
-	optOutResults->push_back({});
-	auto &result = optOutResults->back();
-	InitializeRayCastResult(data, distance, hit.block, result, hit.hasBlock ? RayCastHitType::Block : RayCastHitType::None);
-	return bHitAny;
+
+	// Compound or non-convex query shape, every geometry is tested individually in a single pass and the results are merged
+	auto anyHit = queryFilterData.flags.isSet(physx::PxQueryFlag::eANY_HIT);
+	std::vector<std::pair<physx::PxOverlapHit, RayCastHitType>> hits {};
+	SceneReadScope lock {*this};
+	for(auto &queryGeometry : queryGeometries) {
+		overlap_geometry(*m_scene, *queryGeometry.geometry, pose * queryGeometry.localPose, queryFilterData, pxFilter.get(), hits);
+		if(anyHit && hits.empty() == false)
+			break;
+	}
+	return InitializeQueryResults(data, 0.f, hits, optOutResults);
 }
 
 Bool pragma::physics::PhysXEnvironment::RayCast(const TraceData &data, std::vector<TraceResult> *optOutResults) const
 {
+	PhysXSceneQueryProfiler::QueryScope profilerScope {m_sceneQueryProfiler.get(), PhysXSceneQueryProfiler::QueryType::RayCast};
 	auto origin = ToPhysXVector(data.GetSourceOrigin());
 	auto target = ToPhysXVector(data.GetTargetOrigin());
 	auto unitDir = target - origin;
@@ -177,7 +422,9 @@ Bool pragma::physics::PhysXEnvironment::RayCast(const TraceData &data, std::vect
 	std::array<physx::PxRaycastHit, 32> touchingHits; // Arbitrary maximum number of touches
 	hit.touches = touchingHits.data();
 	hit.maxNbTouches = touchingHits.size();
+	SceneReadScope lock {*this};
 	auto bHitAny = m_scene->raycast(origin, unitDir, distance, hit, hitFlags, queryFilterData, pxFilter.get());
+	PhysXSceneQueryProfiler::RecordTouches(hit);
 	if(optOutResults == nullptr || bHitAny == false)
 		return bHitAny;
 	auto numTouches = hit.getNbTouches();
@@ -195,11 +442,14 @@ Bool pragma::physics::PhysXEnvironment::RayCast(const TraceData &data, std::vect
 }
 Bool pragma::physics::PhysXEnvironment::Sweep(const TraceData &data, std::vector<TraceResult> *optOutResults) const
 {
+	PhysXSceneQueryProfiler::QueryScope profilerScope {m_sceneQueryProfiler.get(), PhysXSceneQueryProfiler::QueryType::Sweep};
 	auto *shape = data.GetShape();
-	if(shape == nullptr || shape->IsConvex() == false)
+	if(shape == nullptr)
 		return false;
-	auto &convexShape = static_cast<const PhysXConvexShape &>(PhysXShape::GetShape(*shape));
-	if(convexShape.m_geometry == nullptr)
+	// Only convex geometry can be swept
+	QueryGeometries queryGeometries {};
+	get_query_geometries(*shape, queryGeometries, true);
+	if(queryGeometries.empty())
 		return false;
 	physx::PxTransform pose {ToPhysXVector(data.GetSourceOrigin()), ToPhysXRotation(data.GetSourceRotation())};
 	auto target = data.GetTargetOrigin();
@@ -217,19 +467,662 @@ Bool pragma::physics::PhysXEnvironment::Sweep(const TraceData &data, std::vector
 	std::array<physx::PxSweepHit, 32> touchingHits; // Arbitrary maximum number of touches
 	hit.touches = touchingHits.data();
 	hit.maxNbTouches = touchingHits.size();
-	auto bHitAny = m_scene->sweep(*convexShape.m_geometry, pose, unitDir, distance, hit, hitFlags, queryFilterData, pxFilter.get());
-	if(optOutResults == nullptr || bHitAny == false)
-		return bHitAny;
-	auto numTouches = hit.getNbTouches();
-	optOutResults->reserve(numTouches + 1);
-	for(auto i = decltype(numTouches) {0u}; i < numTouches; ++i) {
-		auto &touchHit = hit.getTouch(i);
+	if(queryGeometries.size() == 1) {
+		SceneReadScope lock {*this};
+		auto bHitAny = m_scene->sweep(*queryGeometries.front().geometry, pose * queryGeometries.front().localPose, unitDir, distance, hit, hitFlags, queryFilterData, pxFilter.get());
+		PhysXSceneQueryProfiler::RecordTouches(hit);
+		if(optOutResults == nullptr || bHitAny == false)
+			return bHitAny;
+		auto numTouches = hit.getNbTouches();
+		optOutResults->reserve(numTouches + 1);
+		for(auto i = decltype(numTouches) {0u}; i < numTouches; ++i) {
+			auto &touchHit = hit.getTouch(i);
+			optOutResults->push_back({});
+			auto &result = optOutResults->back();
+			InitializeRayCastResult(data, distance, touchHit, result, RayCastHitType::Touch);
+		}
 		optOutResults->push_back({});
 		auto &result = optOutResults->back();
-		InitializeRayCastResult(data, distance, touchHit, result, RayCastHitType::Touch);
+		InitializeRayCastResult(data, distance, hit.block, result, hit.hasBlock ? RayCastHitType::Block : RayCastHitType::None);
+		return bHitAny;
 	}
-	optOutResults->push_back({});
-	auto &result = optOutResults->back();
-	InitializeRayCastResult(data, distance, hit.block, result, hit.hasBlock ? RayCastHitType::Block : RayCastHitType::None);
-	return bHitAny;
+
+	// Compound query shape, every sub-shape is swept individually in a single pass and the results are merged
+	auto anyHit = queryFilterData.flags.isSet(physx::PxQueryFlag::eANY_HIT);
+	std::vector<std::pair<physx::PxSweepHit, RayCastHitType>> hits {};
+	SceneReadScope lock {*this};
+	for(auto &queryGeometry : queryGeometries) {
+		if(m_scene->sweep(*queryGeometry.geometry, pose * queryGeometry.localPose, unitDir, distance, hit, hitFlags, queryFilterData, pxFilter.get())) {
+			PhysXSceneQueryProfiler::RecordTouches(hit);
+			add_query_hits(hits, hit);
+		}
+		if(anyHit && hits.empty() == false)
+			break;
+	}
+	return InitializeQueryResults(data, distance, hits, optOutResults);
+}
+
+namespace {
+	// Used in combination with eNO_BLOCK, which reports all hits as touches. Keeps track of
+	// which shapes would have been blocking, so they can still be reported as such.
+	class BlockRecordingFilterCallback : public physx::PxQueryFilterCallback {
+	  public:
+		BlockRecordingFilterCallback(physx::PxQueryFilterCallback *filter, bool hasPreFilter, bool hasPostFilter) : m_filter {filter}, m_hasPreFilter {hasPreFilter}, m_hasPostFilter {hasPostFilter} {}
+		virtual physx::PxQueryHitType::Enum preFilter(const physx::PxFilterData &filterData, const physx::PxShape *shape, const physx::PxRigidActor *actor, physx::PxHitFlags &queryFlags) override
+		{
+			auto hitType = (m_filter && m_hasPreFilter) ? m_filter->preFilter(filterData, shape, actor, queryFlags) : physx::PxQueryHitType::eBLOCK;
+			if(hitType == physx::PxQueryHitType::eBLOCK)
+				m_blockingShapes.insert(shape);
+			return hitType;
+		}
+		virtual physx::PxQueryHitType::Enum postFilter(const physx::PxFilterData &filterData, const physx::PxQueryHit &hit, const physx::PxShape *shape, const physx::PxRigidActor *actor) override
+		{
+			// Only called if the wrapped filter has a post-filter
+			auto hitType = m_filter->postFilter(filterData, hit, shape, actor);
+			if(hitType == physx::PxQueryHitType::eBLOCK)
+				m_blockingShapes.insert(shape);
+			else
+				m_blockingShapes.erase(shape);
+			return hitType;
+		}
+		bool IsBlocking(const physx::PxShape *shape) const { return m_blockingShapes.find(shape) != m_blockingShapes.end(); }
+	  private:
+		physx::PxQueryFilterCallback *m_filter = nullptr;
+		bool m_hasPreFilter = false;
+		bool m_hasPostFilter = false;
+		std::unordered_set<const physx::PxShape *> m_blockingShapes {};
+	};
+
+	// Collects all touches of a multi-hit query. The touch buffer is flushed into the hit list whenever it is full,
+	// so no hits are lost regardless of how many there are. If only the closest maxHits hits are requested,
+	// the hit list is trimmed to those whenever it grows too large.
+	template<class THit>
+	class MultiHitCallback : public physx::PxHitCallback<THit> {
+	  public:
+		MultiHitCallback(const BlockRecordingFilterCallback *blockRecorder, bool mergeDuplicates, uint32_t maxHits, std::vector<std::pair<THit, RayCastHitType>> &hits)
+		    : physx::PxHitCallback<THit> {m_touchBuffer.data(), static_cast<physx::PxU32>(m_touchBuffer.size())}, m_blockRecorder {blockRecorder}, m_mergeDuplicates {mergeDuplicates}, m_maxHits {maxHits}, m_hits {hits}
+		{
+		}
+		virtual physx::PxAgain processTouches(const THit *buffer, physx::PxU32 nbHits) override
+		{
+			auto *sample = pragma::physics::PhysXSceneQueryProfiler::GetActiveSample();
+			if(sample)
+				sample->touchCount += nbHits;
+			for(auto i = decltype(nbHits) {0u}; i < nbHits; ++i) {
+				auto &touchHit = buffer[i];
+				AddHit(touchHit, (m_blockRecorder && m_blockRecorder->IsBlocking(touchHit.shape)) ? RayCastHitType::Block : RayCastHitType::Touch);
+			}
+			if(m_maxHits > 0 && m_hits.size() > m_maxHits * 2) {
+				std::nth_element(m_hits.begin(), m_hits.begin() + m_maxHits, m_hits.end(), [](const std::pair<THit, RayCastHitType> &a, const std::pair<THit, RayCastHitType> &b) { return get_hit_distance(a.first) < get_hit_distance(b.first); });
+				m_hits.resize(m_maxHits);
+			}
+			return true;
+		}
+		virtual void finalizeQuery() override
+		{
+			// Touches of the last batch that didn't fill up the buffer
+			processTouches(this->touches, this->nbTouches);
+			this->nbTouches = 0;
+			if(this->hasBlock)
+				AddHit(this->block, RayCastHitType::Block);
+		}
+	  private:
+		void AddHit(const THit &hit, RayCastHitType hitType)
+		{
+			if(m_mergeDuplicates)
+				add_query_hit(m_hits, hit, hitType);
+			else
+				m_hits.push_back({hit, hitType});
+		}
+		std::array<THit, 128> m_touchBuffer;
+		const BlockRecordingFilterCallback *m_blockRecorder = nullptr;
+		bool m_mergeDuplicates = false;
+		uint32_t m_maxHits = 0;
+		std::vector<std::pair<THit, RayCastHitType>> &m_hits;
+	};
+};
+static std::unique_ptr<BlockRecordingFilterCallback> get_block_recording_filter(physx::PxQueryFilterData &queryFilterData, pragma::physics::RayCastFilterCallback *filter, const pragma::physics::PhysXEnvironment::MultiHitOptions &options)
+{
+	if(options.stopAtFirstBlock)
+		return nullptr; // The scene already discards everything behind the closest block
+	auto blockRecorder = std::make_unique<BlockRecordingFilterCallback>(filter, queryFilterData.flags.isSet(physx::PxQueryFlag::ePREFILTER), queryFilterData.flags.isSet(physx::PxQueryFlag::ePOSTFILTER));
+	queryFilterData.flags |= physx::PxQueryFlag::eNO_BLOCK | physx::PxQueryFlag::ePREFILTER;
+	queryFilterData.flags &= ~physx::PxQueryFlag::eANY_HIT;
+	return blockRecorder;
+}
+template<class THit>
+Bool pragma::physics::PhysXEnvironment::InitializeSortedQueryResults(const TraceData &data, float distance, std::vector<std::pair<THit, RayCastHitType>> &hits, const MultiHitOptions &options, std::vector<TraceResult> &outResults) const
+{
+	if(options.stopAtFirstBlock) {
+		auto blockDistance = std::numeric_limits<float>::max();
+		for(auto &pair : hits) {
+			if(pair.second == RayCastHitType::Block)
+				blockDistance = std::min(blockDistance, get_hit_distance(pair.first));
+		}
+		hits.erase(std::remove_if(hits.begin(), hits.end(), [blockDistance](const std::pair<THit, RayCastHitType> &pair) { return get_hit_distance(pair.first) > blockDistance; }), hits.end());
+	}
+	auto numResults = hits.size();
+	if(options.maxHits > 0)
+		numResults = std::min<size_t>(numResults, options.maxHits);
+	// We only need the closest numResults hits to be in order
+	std::partial_sort(hits.begin(), hits.begin() + numResults, hits.end(), [](const std::pair<THit, RayCastHitType> &a, const std::pair<THit, RayCastHitType> &b) { return get_hit_distance(a.first) < get_hit_distance(b.first); });
+	outResults.reserve(outResults.size() + numResults);
+	for(auto i = decltype(numResults) {0u}; i < numResults; ++i) {
+		outResults.push_back({});
+		InitializeRayCastResult(data, distance, hits[i].first, outResults.back(), hits[i].second);
+	}
+	return hits.empty() == false;
+}
+pragma::physics::PhysXEnvironment::SceneQueryPreset pragma::physics::PhysXEnvironment::CreateSceneQueryPreset(const TraceData &data)
+{
+	SceneQueryPreset preset {};
+	physx::PxQueryFlags queryFlags;
+	translate_raycast_flags(data.GetFlags(), preset.hitFlags, queryFlags);
+	preset.queryFilterData = physx::PxQueryFilterData {queryFlags};
+	pragma::physics::PhysXEnvironment::ApplyQueryCollisionMask(data.GetCollisionFilterMask(), preset.queryFilterData);
+	preset.anyHit = queryFlags.isSet(physx::PxQueryFlag::eANY_HIT);
+	return preset;
+}
+template<bool TAnyHit>
+Bool pragma::physics::PhysXEnvironment::RayCastWithPreset(const TraceData &data, const SceneQueryPreset &preset, const physx::PxVec3 &origin, const physx::PxVec3 &unitDir, float distance, std::vector<TraceResult> *optOutResults) const
+{
+	physx::PxRaycastBuffer hit {};
+	if constexpr(TAnyHit) {
+		// Any-hit queries never report touches, so no touch buffer is required
+		{
+			SceneReadScope lock {*this};
+			if(m_scene->raycast(origin, unitDir, distance, hit, preset.hitFlags, preset.queryFilterData) == false)
+				return false;
+		}
+		if(optOutResults) {
+			optOutResults->push_back({});
+			InitializeRayCastResult(data, distance, hit.block, optOutResults->back(), RayCastHitType::Block);
+		}
+		return true;
+	}
+	else {
+		std::array<physx::PxRaycastHit, 32> touchingHits; // Arbitrary maximum number of touches
+		hit.touches = touchingHits.data();
+		hit.maxNbTouches = touchingHits.size();
+		SceneReadScope lock {*this};
+		auto bHitAny = m_scene->raycast(origin, unitDir, distance, hit, preset.hitFlags, preset.queryFilterData);
+		PhysXSceneQueryProfiler::RecordTouches(hit);
+		if(optOutResults == nullptr || bHitAny == false)
+			return bHitAny;
+		auto numTouches = hit.getNbTouches();
+		optOutResults->reserve(optOutResults->size() + numTouches + 1);
+		for(auto i = decltype(numTouches) {0u}; i < numTouches; ++i) {
+			optOutResults->push_back({});
+			InitializeRayCastResult(data, distance, hit.getTouch(i), optOutResults->back(), RayCastHitType::Touch);
+		}
+		optOutResults->push_back({});
+		InitializeRayCastResult(data, distance, hit.block, optOutResults->back(), hit.hasBlock ? RayCastHitType::Block : RayCastHitType::None);
+		return bHitAny;
+	}
+}
+Bool pragma::physics::PhysXEnvironment::RayCast(const TraceData &data, const SceneQueryPreset &preset, std::vector<TraceResult> *optOutResults) const
+{
+	PhysXSceneQueryProfiler::QueryScope profilerScope {m_sceneQueryProfiler.get(), PhysXSceneQueryProfiler::QueryType::RayCast};
+	auto origin = ToPhysXVector(data.GetSourceOrigin());
+	auto target = ToPhysXVector(data.GetTargetOrigin());
+	auto unitDir = target - origin;
+	auto distance = unitDir.magnitude();
+	if(distance == 0.f)
+		return false;
+	unitDir /= distance;
+	if(preset.anyHit)
+		return RayCastWithPreset<true>(data, preset, origin, unitDir, distance, optOutResults);
+	return RayCastWithPreset<false>(data, preset, origin, unitDir, distance, optOutResults);
+}
+Bool pragma::physics::PhysXEnvironment::Sweep(const TraceData &data, const SceneQueryPreset &preset, std::vector<TraceResult> *optOutResults) const
+{
+	PhysXSceneQueryProfiler::QueryScope profilerScope {m_sceneQueryProfiler.get(), PhysXSceneQueryProfiler::QueryType::Sweep};
+	auto *shape = data.GetShape();
+	if(shape == nullptr)
+		return false;
+	QueryGeometries queryGeometries {};
+	get_query_geometries(*shape, queryGeometries, true);
+	if(queryGeometries.empty())
+		return false;
+	physx::PxTransform pose {ToPhysXVector(data.GetSourceOrigin()), ToPhysXRotation(data.GetSourceRotation())};
+	auto target = data.GetTargetOrigin();
+	auto distance = uvec::length(target);
+	if(distance == 0.f)
+		return false;
+	auto unitDir = ToPhysXVector(target);
+	unitDir /= distance;
+
+	physx::PxSweepBuffer hit {};
+	std::array<physx::PxSweepHit, 32> touchingHits; // Arbitrary maximum number of touches
+	if(preset.anyHit == false) {
+		hit.touches = touchingHits.data();
+		hit.maxNbTouches = touchingHits.size();
+	}
+	if(queryGeometries.size() == 1) {
+		// Results are written directly, no merging required
+		SceneReadScope lock {*this};
+		auto bHitAny = m_scene->sweep(*queryGeometries.front().geometry, pose * queryGeometries.front().localPose, unitDir, distance, hit, preset.hitFlags, preset.queryFilterData);
+		PhysXSceneQueryProfiler::RecordTouches(hit);
+		if(optOutResults == nullptr || bHitAny == false)
+			return bHitAny;
+		auto numTouches = hit.getNbTouches();
+		optOutResults->reserve(optOutResults->size() + numTouches + 1);
+		for(auto i = decltype(numTouches) {0u}; i < numTouches; ++i) {
+			optOutResults->push_back({});
+			InitializeRayCastResult(data, distance, hit.getTouch(i), optOutResults->back(), RayCastHitType::Touch);
+		}
+		optOutResults->push_back({});
+		InitializeRayCastResult(data, distance, hit.block, optOutResults->back(), (preset.anyHit || hit.hasBlock) ? RayCastHitType::Block : RayCastHitType::None);
+		return bHitAny;
+	}
+
+	// Compound query shape, the hits of all sub-shapes are merged
+	std::vector<std::pair<physx::PxSweepHit, RayCastHitType>> hits {};
+	SceneReadScope lock {*this};
+	for(auto &queryGeometry : queryGeometries) {
+		if(m_scene->sweep(*queryGeometry.geometry, pose * queryGeometry.localPose, unitDir, distance, hit, preset.hitFlags, preset.queryFilterData) == false)
+			continue;
+		PhysXSceneQueryProfiler::RecordTouches(hit);
+		add_query_hits(hits, hit);
+		if(preset.anyHit)
+			break;
+	}
+	return InitializeQueryResults(data, distance, hits, optOutResults);
+}
+
+Bool pragma::physics::PhysXEnvironment::RayCastSorted(const TraceData &data, std::vector<TraceResult> &outResults, const MultiHitOptions &options) const
+{
+	PhysXSceneQueryProfiler::QueryScope profilerScope {m_sceneQueryProfiler.get(), PhysXSceneQueryProfiler::QueryType::RayCast};
+	auto origin = ToPhysXVector(data.GetSourceOrigin());
+	auto target = ToPhysXVector(data.GetTargetOrigin());
+	auto unitDir = target - origin;
+	auto distance = unitDir.magnitude();
+	if(distance == 0.f)
+		return false;
+	unitDir /= distance;
+
+	auto hitFlags = static_cast<physx::PxHitFlags>(0);
+	physx::PxQueryFilterData queryFilterData {};
+	auto pxFilter = get_raycast_filter(*this, data, hitFlags, queryFilterData);
+	auto blockRecorder = get_block_recording_filter(queryFilterData, pxFilter.get(), options);
+	auto *filter = blockRecorder ? static_cast<physx::PxQueryFilterCallback *>(blockRecorder.get()) : pxFilter.get();
+
+	std::vector<std::pair<physx::PxRaycastHit, RayCastHitType>> hits {};
+	MultiHitCallback<physx::PxRaycastHit> hit {blockRecorder.get(), false, options.maxHits, hits};
+	{
+		SceneReadScope lock {*this};
+		if(m_scene->raycast(origin, unitDir, distance, hit, hitFlags, queryFilterData, filter) == false)
+			return false;
+	}
+	return InitializeSortedQueryResults(data, distance, hits, options, outResults);
+}
+Bool pragma::physics::PhysXEnvironment::SweepSorted(const TraceData &data, std::vector<TraceResult> &outResults, const MultiHitOptions &options) const
+{
+	PhysXSceneQueryProfiler::QueryScope profilerScope {m_sceneQueryProfiler.get(), PhysXSceneQueryProfiler::QueryType::Sweep};
+	auto *shape = data.GetShape();
+	if(shape == nullptr)
+		return false;
+	QueryGeometries queryGeometries {};
+	get_query_geometries(*shape, queryGeometries, true);
+	if(queryGeometries.empty())
+		return false;
+	physx::PxTransform pose {ToPhysXVector(data.GetSourceOrigin()), ToPhysXRotation(data.GetSourceRotation())};
+	auto target = data.GetTargetOrigin();
+	auto distance = uvec::length(target);
+	if(distance == 0.f)
+		return false;
+	auto unitDir = ToPhysXVector(target);
+	unitDir /= distance;
+
+	auto hitFlags = static_cast<physx::PxHitFlags>(0);
+	physx::PxQueryFilterData queryFilterData {};
+	auto pxFilter = get_raycast_filter(*this, data, hitFlags, queryFilterData);
+	auto blockRecorder = get_block_recording_filter(queryFilterData, pxFilter.get(), options);
+	auto *filter = blockRecorder ? static_cast<physx::PxQueryFilterCallback *>(blockRecorder.get()) : pxFilter.get();
+
+	std::vector<std::pair<physx::PxSweepHit, RayCastHitType>> hits {};
+	auto mergeDuplicates = (queryGeometries.size() > 1);
+	SceneReadScope lock {*this};
+	for(auto &queryGeometry : queryGeometries) {
+		MultiHitCallback<physx::PxSweepHit> hit {blockRecorder.get(), mergeDuplicates, options.maxHits, hits};
+		m_scene->sweep(*queryGeometry.geometry, pose * queryGeometry.localPose, unitDir, distance, hit, hitFlags, queryFilterData, filter);
+	}
+	return InitializeSortedQueryResults(data, distance, hits, options, outResults);
+}
+
+bool pragma::physics::PhysXEnvironment::PenetrationTrace(const TraceData &data, std::vector<PenetrationHit> &outHits) const
+{
+	PhysXSceneQueryProfiler::QueryScope profilerScope {m_sceneQueryProfiler.get(), PhysXSceneQueryProfiler::QueryType::RayCast};
+	outHits.clear();
+	auto origin = ToPhysXVector(data.GetSourceOrigin());
+	auto target = ToPhysXVector(data.GetTargetOrigin());
+	auto unitDir = target - origin;
+	auto distance = unitDir.magnitude();
+	if(distance == 0.f)
+		return false;
+	unitDir /= distance;
+
+	auto hitFlags = static_cast<physx::PxHitFlags>(0);
+	physx::PxQueryFilterData queryFilterData {};
+	auto pxFilter = get_raycast_filter(*this, data, hitFlags, queryFilterData);
+	// The forward pass only reports front faces, which are the entry points. Blocking hits must not end the trace,
+	// so everything is reported as a touch.
+	hitFlags |= physx::PxHitFlag::ePOSITION | physx::PxHitFlag::eNORMAL | physx::PxHitFlag::eFACE_INDEX | physx::PxHitFlag::eMESH_MULTIPLE;
+	hitFlags &= ~(physx::PxHitFlag::eMESH_ANY | physx::PxHitFlag::eMESH_BOTH_SIDES);
+	queryFilterData.flags |= physx::PxQueryFlag::eNO_BLOCK;
+	queryFilterData.flags &= ~physx::PxQueryFlag::eANY_HIT;
+
+	// The buffers are re-used by all traces of the same thread. If a buffer is full, some of the hits may have been dropped,
+	// in which case the buffer is grown and the query repeated, so that every entry can be paired with the correct exit.
+	static thread_local std::vector<physx::PxRaycastHit> touchingHits(128);
+	static thread_local std::vector<physx::PxRaycastHit> exitHits(8);
+	physx::PxRaycastBuffer hit {};
+	SceneReadScope lock {*this};
+	for(;;) {
+		hit = {};
+		hit.touches = touchingHits.data();
+		hit.maxNbTouches = touchingHits.size();
+		if(m_scene->raycast(origin, unitDir, distance, hit, hitFlags, queryFilterData, pxFilter.get()) == false)
+			return false;
+		if(hit.getNbTouches() < hit.maxNbTouches)
+			break;
+		touchingHits.resize(touchingHits.size() * 2);
+	}
+	PhysXSceneQueryProfiler::RecordTouches(hit);
+	auto numTouches = hit.getNbTouches();
+	// Group the entry points by shape, so every shape only has to be traced in reverse once
+	std::sort(touchingHits.begin(), touchingHits.begin() + numTouches, [](const physx::PxRaycastHit &a, const physx::PxRaycastHit &b) { return (a.shape != b.shape) ? (a.shape < b.shape) : (a.distance < b.distance); });
+
+	// The exit points are the front faces of the geometry when seen from the end of the trace
+	auto exitHitFlags = physx::PxHitFlag::ePOSITION | physx::PxHitFlag::eNORMAL | physx::PxHitFlag::eMESH_MULTIPLE;
+	outHits.reserve(numTouches);
+	for(auto i = decltype(numTouches) {0u}; i < numTouches;) {
+		auto *pxShape = touchingHits[i].shape;
+		auto *actor = touchingHits[i].actor;
+		auto end = i;
+		while(end < numTouches && touchingHits[end].shape == pxShape)
+			++end;
+		// Closed geometry has at most one more exit than entries (if the trace starts inside of it)
+		if(exitHits.size() < (end - i) + 1)
+			exitHits.resize((end - i) + 1);
+		auto globalPose = physx::PxShapeExt::getGlobalPose(*pxShape, *actor);
+		physx::PxU32 numExits;
+		for(;;) {
+			numExits = physx::PxGeometryQuery::raycast(target, -unitDir, pxShape->getGeometry(), globalPose, distance, exitHitFlags, exitHits.size(), exitHits.data(), sizeof(physx::PxRaycastHit));
+			if(numExits < exitHits.size())
+				break;
+			exitHits.resize(exitHits.size() * 2);
+		}
+		// Convert to distances from the trace origin
+		for(auto j = decltype(numExits) {0u}; j < numExits; ++j)
+			exitHits[j].distance = distance - exitHits[j].distance;
+		std::sort(exitHits.begin(), exitHits.begin() + numExits, [](const physx::PxRaycastHit &a, const physx::PxRaycastHit &b) { return a.distance < b.distance; });
+
+		auto *colObj = actor ? GetCollisionObject(*actor) : nullptr;
+		auto *shape = GetShape(*pxShape);
+		// Every entry point is paired with the closest exit point behind it
+		auto exitIndex = decltype(numExits) {0u};
+		auto lastExitDistance = -1.f;
+		for(auto j = i; j < end; ++j) {
+			auto &entryHit = touchingHits[j];
+			if(entryHit.distance < lastExitDistance)
+				continue; // Inner surface of a solid we have already passed through
+			while(exitIndex < numExits && exitHits[exitIndex].distance < entryHit.distance)
+				++exitIndex;
+			outHits.push_back({});
+			auto &penetrationHit = outHits.back();
+			penetrationHit.collisionObject = colObj ? util::weak_shared_handle_cast<IBase, ICollisionObject>(colObj->GetHandle()) : util::TWeakSharedHandle<ICollisionObject> {};
+			penetrationHit.shape = shape ? std::static_pointer_cast<IShape>(shape->GetShape().shared_from_this()) : nullptr;
+			auto *material = pxShape->getMaterialFromInternalFaceIndex(entryHit.faceIndex);
+			penetrationHit.material = material ? std::static_pointer_cast<IMaterial>(GetMaterial(*material)->shared_from_this()) : nullptr;
+			penetrationHit.entryPosition = FromPhysXVector(entryHit.position);
+			penetrationHit.entryNormal = FromPhysXNormal(entryHit.normal);
+			penetrationHit.entryDistance = FromPhysXLength(entryHit.distance);
+			if(exitIndex < numExits) {
+				auto &exitHit = exitHits[exitIndex++];
+				// An exit at the very end of the trace means the trace ends inside of the geometry
+				penetrationHit.hasExit = (exitHit.distance < distance);
+				penetrationHit.exitPosition = FromPhysXVector(exitHit.position);
+				penetrationHit.exitNormal = FromPhysXNormal(exitHit.normal);
+				lastExitDistance = exitHit.distance;
+			}
+			else {
+				penetrationHit.hasExit = false;
+				penetrationHit.exitPosition = FromPhysXVector(target);
+				lastExitDistance = distance;
+			}
+			penetrationHit.thickness = FromPhysXLength(lastExitDistance - entryHit.distance);
+		}
+		i = end;
+	}
+	std::sort(outHits.begin(), outHits.end(), [](const PenetrationHit &a, const PenetrationHit &b) { return a.entryDistance < b.entryDistance; });
+	return outHits.empty() == false;
+}
+void pragma::physics::PhysXEnvironment::PenetrationTraces(const std::vector<TraceData> &data, std::vector<std::vector<PenetrationHit>> &outHits) const
+{
+	outHits.clear();
+	outHits.resize(data.size());
+	ParallelFor(data.size(), 8, [this, &data, &outHits](uint32_t start, uint32_t end) {
+		for(auto i = start; i < end; ++i)
+			PenetrationTrace(data[i], outHits[i]);
+	});
+}
+
+std::vector<pragma::physics::PhysXEnvironment::QueryTarget> pragma::physics::PhysXEnvironment::GetQueryTargets(const std::vector<ICollisionObject *> &targets) const
+{
+	std::vector<QueryTarget> queryTargets {};
+	queryTargets.reserve(targets.size());
+	SceneReadScope lock {*this};
+	for(auto *target : targets) {
+		if(target == nullptr)
+			continue;
+		// Only objects that have been removed from the world (or have no rigid actor, like soft bodies) are skipped,
+		// everything else only needs the shapes and the pose of the actor.
+		auto &o = PhysXCollisionObject::GetCollisionObject(*target);
+		auto *actor = o.HasInternalObject() ? o.GetInternalObject().is<physx::PxRigidActor>() : nullptr;
+		if(actor == nullptr)
+			continue;
+		queryTargets.push_back({&o, actor, actor->getGlobalPose()});
+	}
+	return queryTargets;
+}
+
+std::vector<pragma::physics::PhysXEnvironment::QueryTarget> pragma::physics::PhysXEnvironment::GetQueryTargets(double time) const
+{
+	auto &tracks = m_poseHistory->GetTracks();
+	std::vector<QueryTarget> queryTargets {};
+	queryTargets.reserve(tracks.size());
+	SceneReadScope lock {*this};
+	for(auto &track : tracks) {
+		auto *body = track.body.Get();
+		physx::PxTransform pose;
+		if(body == nullptr || PhysXPoseHistory::GetPose(track, time, pose) == false)
+			continue;
+		auto &o = PhysXCollisionObject::GetCollisionObject(*body);
+		auto *actor = o.HasInternalObject() ? o.GetInternalObject().is<physx::PxRigidActor>() : nullptr;
+		if(actor == nullptr)
+			continue;
+		queryTargets.push_back({&o, actor, pose});
+	}
+	return queryTargets;
+}
+
+Bool pragma::physics::PhysXEnvironment::OverlapTargets(const TraceData &data, const std::vector<ICollisionObject *> &targets, std::vector<TraceResult> *optOutResults) const
+{
+	auto queryTargets = GetQueryTargets(targets);
+	return OverlapTargets(data, queryTargets.data(), queryTargets.size(), optOutResults);
+}
+Bool pragma::physics::PhysXEnvironment::RayCastTargets(const TraceData &data, const std::vector<ICollisionObject *> &targets, std::vector<TraceResult> *optOutResults) const
+{
+	auto queryTargets = GetQueryTargets(targets);
+	return RayCastTargets(data, queryTargets.data(), queryTargets.size(), optOutResults);
+}
+Bool pragma::physics::PhysXEnvironment::SweepTargets(const TraceData &data, const std::vector<ICollisionObject *> &targets, std::vector<TraceResult> *optOutResults) const
+{
+	auto queryTargets = GetQueryTargets(targets);
+	return SweepTargets(data, queryTargets.data(), queryTargets.size(), optOutResults);
+}
+
+Bool pragma::physics::PhysXEnvironment::OverlapHistory(const TraceData &data, double time, std::vector<TraceResult> *optOutResults) const
+{
+	auto queryTargets = GetQueryTargets(time);
+	return OverlapTargets(data, queryTargets.data(), queryTargets.size(), optOutResults);
+}
+Bool pragma::physics::PhysXEnvironment::RayCastHistory(const TraceData &data, double time, std::vector<TraceResult> *optOutResults) const
+{
+	auto queryTargets = GetQueryTargets(time);
+	return RayCastTargets(data, queryTargets.data(), queryTargets.size(), optOutResults);
+}
+Bool pragma::physics::PhysXEnvironment::SweepHistory(const TraceData &data, double time, std::vector<TraceResult> *optOutResults) const
+{
+	auto queryTargets = GetQueryTargets(time);
+	return SweepTargets(data, queryTargets.data(), queryTargets.size(), optOutResults);
+}
+
+Bool pragma::physics::PhysXEnvironment::OverlapTargets(const TraceData &data, const QueryTarget *targets, size_t numTargets, std::vector<TraceResult> *optOutResults) const
+{
+	auto *shape = data.GetShape();
+	if(shape == nullptr)
+		return false;
+	QueryGeometries queryGeometries {};
+	get_query_geometries(*shape, queryGeometries);
+	if(queryGeometries.empty())
+		return false;
+	physx::PxTransform pose {ToPhysXVector(data.GetSourceOrigin()), ToPhysXRotation(data.GetSourceRotation())};
+
+	auto hitFlags = static_cast<physx::PxHitFlags>(0);
+	physx::PxQueryFilterData queryFilterData {};
+	auto pxFilter = get_raycast_filter(*this, data, hitFlags, queryFilterData);
+	auto anyHit = queryFilterData.flags.isSet(physx::PxQueryFlag::eANY_HIT);
+
+	std::vector<std::pair<physx::PxOverlapHit, RayCastHitType>> hits {};
+	for(auto i = decltype(numTargets) {0u}; i < numTargets; ++i) {
+		auto &target = targets[i];
+		auto &actor = *target.actor;
+		for(auto &actorShape : target.object->GetActorShapeCollection().GetActorShapes()) {
+			auto &pxShape = actorShape->GetActorShape();
+			auto shapeHitFlags = hitFlags;
+			auto hitType = to_raycast_hit_type(prefilter_query_shape(queryFilterData, pxFilter.get(), actor, pxShape, shapeHitFlags));
+			if(hitType == RayCastHitType::None)
+				continue;
+			auto &targetGeometry = pxShape.getGeometry();
+			auto targetPose = target.actorPose * pxShape.getLocalPose();
+			auto overlaps = std::any_of(queryGeometries.begin(), queryGeometries.end(), [&pose, &targetGeometry, &targetPose](const QueryGeometry &queryGeometry) {
+				return is_overlap_supported(*queryGeometry.geometry, targetGeometry) && physx::PxGeometryQuery::overlap(*queryGeometry.geometry, pose * queryGeometry.localPose, targetGeometry, targetPose);
+			});
+			if(overlaps == false)
+				continue;
+			physx::PxOverlapHit hit {};
+			hit.actor = &actor;
+			hit.shape = &pxShape;
+			if(postfilter_query_hit(queryFilterData, pxFilter.get(), hit, hitType) == false)
+				continue;
+			hits.push_back({hit, anyHit ? RayCastHitType::Block : hitType});
+			if(anyHit)
+				return InitializeQueryResults(data, 0.f, hits, optOutResults);
+		}
+	}
+	return InitializeQueryResults(data, 0.f, hits, optOutResults);
+}
+Bool pragma::physics::PhysXEnvironment::RayCastTargets(const TraceData &data, const QueryTarget *targets, size_t numTargets, std::vector<TraceResult> *optOutResults) const
+{
+	auto origin = ToPhysXVector(data.GetSourceOrigin());
+	auto target = ToPhysXVector(data.GetTargetOrigin());
+	auto unitDir = target - origin;
+	auto distance = unitDir.magnitude();
+	if(distance == 0.f)
+		return false;
+	unitDir /= distance;
+
+	auto hitFlags = static_cast<physx::PxHitFlags>(0);
+	physx::PxQueryFilterData queryFilterData {};
+	auto pxFilter = get_raycast_filter(*this, data, hitFlags, queryFilterData);
+	auto anyHit = queryFilterData.flags.isSet(physx::PxQueryFlag::eANY_HIT);
+
+	std::vector<std::pair<physx::PxRaycastHit, RayCastHitType>> hits {};
+	std::array<physx::PxRaycastHit, 8> shapeHits; // Arbitrary maximum number of hits per triangle mesh
+	for(auto i = decltype(numTargets) {0u}; i < numTargets; ++i) {
+		auto &queryTarget = targets[i];
+		auto &actor = *queryTarget.actor;
+		for(auto &actorShape : queryTarget.object->GetActorShapeCollection().GetActorShapes()) {
+			auto &pxShape = actorShape->GetActorShape();
+			auto shapeHitFlags = hitFlags;
+			auto hitType = to_raycast_hit_type(prefilter_query_shape(queryFilterData, pxFilter.get(), actor, pxShape, shapeHitFlags));
+			if(hitType == RayCastHitType::None)
+				continue;
+			auto maxHits = shapeHitFlags.isSet(physx::PxHitFlag::eMESH_MULTIPLE) ? static_cast<physx::PxU32>(shapeHits.size()) : 1u;
+			auto numHits = physx::PxGeometryQuery::raycast(origin, unitDir, pxShape.getGeometry(), queryTarget.actorPose * pxShape.getLocalPose(), distance, shapeHitFlags, maxHits, shapeHits.data(), sizeof(physx::PxRaycastHit));
+			for(auto j = decltype(numHits) {0u}; j < numHits; ++j) {
+				auto &hit = shapeHits[j];
+				hit.actor = &actor;
+				hit.shape = &pxShape;
+				auto hitTypeFiltered = hitType;
+				if(postfilter_query_hit(queryFilterData, pxFilter.get(), hit, hitTypeFiltered) == false)
+					continue;
+				hits.push_back({hit, anyHit ? RayCastHitType::Block : hitTypeFiltered});
+				if(anyHit)
+					return InitializeQueryResults(data, distance, hits, optOutResults);
+			}
+		}
+	}
+	return InitializeQueryResults(data, distance, hits, optOutResults);
+}
+Bool pragma::physics::PhysXEnvironment::SweepTargets(const TraceData &data, const QueryTarget *targets, size_t numTargets, std::vector<TraceResult> *optOutResults) const
+{
+	auto *shape = data.GetShape();
+	if(shape == nullptr)
+		return false;
+	// Only convex geometry can be swept
+	QueryGeometries queryGeometries {};
+	get_query_geometries(*shape, queryGeometries, true);
+	if(queryGeometries.empty())
+		return false;
+	physx::PxTransform pose {ToPhysXVector(data.GetSourceOrigin()), ToPhysXRotation(data.GetSourceRotation())};
+	auto target = data.GetTargetOrigin();
+	auto distance = uvec::length(target);
+	if(distance == 0.f)
+		return false;
+	auto unitDir = ToPhysXVector(target);
+	unitDir /= distance;
+
+	auto hitFlags = static_cast<physx::PxHitFlags>(0);
+	physx::PxQueryFilterData queryFilterData {};
+	auto pxFilter = get_raycast_filter(*this, data, hitFlags, queryFilterData);
+	auto anyHit = queryFilterData.flags.isSet(physx::PxQueryFlag::eANY_HIT);
+
+	std::vector<std::pair<physx::PxSweepHit, RayCastHitType>> hits {};
+	for(auto i = decltype(numTargets) {0u}; i < numTargets; ++i) {
+		auto &queryTarget = targets[i];
+		auto &actor = *queryTarget.actor;
+		for(auto &actorShape : queryTarget.object->GetActorShapeCollection().GetActorShapes()) {
+			auto &pxShape = actorShape->GetActorShape();
+			auto shapeHitFlags = hitFlags;
+			auto hitType = to_raycast_hit_type(prefilter_query_shape(queryFilterData, pxFilter.get(), actor, pxShape, shapeHitFlags));
+			if(hitType == RayCastHitType::None)
+				continue;
+			// Compound query shape, the closest hit of all sub-shapes is used
+			auto targetPose = queryTarget.actorPose * pxShape.getLocalPose();
+			physx::PxSweepHit hit {};
+			auto hasHit = false;
+			for(auto &queryGeometry : queryGeometries) {
+				physx::PxSweepHit geometryHit {};
+				if(physx::PxGeometryQuery::sweep(unitDir, distance, *queryGeometry.geometry, pose * queryGeometry.localPose, pxShape.getGeometry(), targetPose, geometryHit, shapeHitFlags) == false)
+					continue;
+				if(hasHit == false || geometryHit.distance < hit.distance) {
+					hit = geometryHit;
+					hasHit = true;
+				}
+			}
+			if(hasHit == false)
+				continue;
+			hit.actor = &actor;
+			hit.shape = &pxShape;
+			if(postfilter_query_hit(queryFilterData, pxFilter.get(), hit, hitType) == false)
+				continue;
+			hits.push_back({hit, anyHit ? RayCastHitType::Block : hitType});
+			if(anyHit)
+				return InitializeQueryResults(data, distance, hits, optOutResults);
+		}
+	}
+	return InitializeQueryResults(data, distance, hits, optOutResults);
 }
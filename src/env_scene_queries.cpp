@@ -0,0 +1,93 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/environment.hpp"
+#include "pr_physx/scene_query_layers.hpp"
+#include <pragma/networkstate/networkstate.h>
+#include <algorithm>
+
+static pragma::physics::PhysXEnvironment::SceneQuerySettings g_defaultSceneQuerySettings {};
+void pragma::physics::PhysXEnvironment::SetDefaultSceneQuerySettings(const SceneQuerySettings &settings) { g_defaultSceneQuerySettings = settings; }
+const pragma::physics::PhysXEnvironment::SceneQuerySettings &pragma::physics::PhysXEnvironment::GetDefaultSceneQuerySettings() { return g_defaultSceneQuerySettings; }
+
+pragma::physics::PhysXEnvironment::SceneReadScope::SceneReadScope(const PhysXEnvironment &env) : m_scene {env.IsQueryWhileSimulatingEnabled() ? env.m_scene.get() : nullptr}
+{
+	if(m_scene)
+		m_scene->lockRead(__FILE__, __LINE__);
+}
+pragma::physics::PhysXEnvironment::SceneReadScope::~SceneReadScope()
+{
+	if(m_scene)
+		m_scene->unlockRead();
+}
+pragma::physics::PhysXEnvironment::SceneWriteScope::SceneWriteScope(const PhysXEnvironment &env) : m_scene {env.IsQueryWhileSimulatingEnabled() ? env.m_scene.get() : nullptr}
+{
+	if(m_scene)
+		m_scene->lockWrite(__FILE__, __LINE__);
+}
+pragma::physics::PhysXEnvironment::SceneWriteScope::~SceneWriteScope()
+{
+	if(m_scene)
+		m_scene->unlockWrite();
+}
+void pragma::physics::PhysXEnvironment::ApplyQueryCollisionMask(CollisionMask mask, physx::PxQueryFilterData &queryFilterData)
+{
+	if(mask == CollisionMask::All)
+		return;
+	// A word0 of 0 on its own would let all shapes pass, the flag keeps the filter data non-zero for CollisionMask::None
+	queryFilterData.data.word0 = umath::to_integral(mask);
+	queryFilterData.data.word2 |= QUERY_FILTER_COLLISION_MASK_FLAG;
+}
+
+void pragma::physics::PhysXEnvironment::SetSceneQuerySettings(const SceneQuerySettings &settings)
+{
+	if(settings.staticStructure != m_sceneQuerySettings.staticStructure || settings.dynamicStructure != m_sceneQuerySettings.dynamicStructure
+	  || settings.dynamicTreeSecondaryPruner != m_sceneQuerySettings.dynamicTreeSecondaryPruner || settings.queryWhileSimulating != m_sceneQuerySettings.queryWhileSimulating
+	  || settings.layers != m_sceneQuerySettings.layers)
+		Con::cwar << "[PhysX] Scene query pruning structures, layers and locking mode cannot be changed after the scene has been created! Use SetDefaultSceneQuerySettings instead." << Con::endl;
+	m_sceneQuerySettings.dynamicTreeRebuildRateHint = settings.dynamicTreeRebuildRateHint;
+	m_sceneQuerySettings.updateMode = settings.updateMode;
+	if(m_scene == nullptr)
+		return;
+	SceneWriteScope lock {*this};
+	m_scene->setDynamicTreeRebuildRateHint(m_sceneQuerySettings.dynamicTreeRebuildRateHint);
+	m_scene->setSceneQueryUpdateMode(m_sceneQuerySettings.updateMode);
+}
+const pragma::physics::PhysXEnvironment::SceneQuerySettings &pragma::physics::PhysXEnvironment::GetSceneQuerySettings() const { return m_sceneQuerySettings; }
+const pragma::physics::PhysXEnvironment::SceneQueryStats &pragma::physics::PhysXEnvironment::GetSceneQueryStats() const { return m_sceneQueryStats; }
+void pragma::physics::PhysXEnvironment::RebuildSceneQueryTrees(bool rebuildStatic, bool rebuildDynamic)
+{
+	SceneWriteScope lock {*this};
+	m_scene->forceDynamicTreeRebuild(rebuildStatic, rebuildDynamic);
+}
+bool pragma::physics::PhysXEnvironment::IsQueryWhileSimulatingEnabled() const { return m_sceneQuerySettings.queryWhileSimulating; }
+bool pragma::physics::PhysXEnvironment::IsSimulating() const { return m_simulating; }
+bool pragma::physics::PhysXEnvironment::IsSceneQueryLayeringEnabled() const { return m_sceneQueryLayerAdapter != nullptr; }
+uint32_t pragma::physics::PhysXEnvironment::GetSceneQueryLayer(CollisionMask group) const { return m_sceneQueryLayerAdapter ? m_sceneQueryLayerAdapter->GetLayer(group) : 0; }
+
+void pragma::physics::PhysXEnvironment::CommitSceneQueryUpdates()
+{
+	// If commits are disabled, the new trees have been built in parallel to the simulation and we only have to
+	// commit them here. Doing it explicitly (instead of lazily on the first query) keeps the cost out of gameplay code
+	// and lets us measure it.
+	auto tStart = std::chrono::steady_clock::now();
+	if(m_sceneQuerySettings.updateMode != physx::PxSceneQueryUpdateMode::eBUILD_ENABLED_COMMIT_ENABLED)
+		m_scene->flushQueryUpdates();
+	auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tStart);
+
+	auto &stats = m_sceneQueryStats;
+	stats.lastCommitDuration = dt;
+	stats.maxCommitDuration = std::max(stats.maxCommitDuration, dt);
+	auto staticTimestamp = m_scene->getSceneQueryStaticTimestamp();
+	if(staticTimestamp != m_lastSceneQueryStaticTimestamp) {
+		m_lastSceneQueryStaticTimestamp = staticTimestamp;
+		++stats.staticTreeChangeCount;
+		stats.stepsSinceStaticTreeChange = 0;
+	}
+	else
+		++stats.stepsSinceStaticTreeChange;
+	stats.dynamicTreeRebuildRateHint = m_scene->getDynamicTreeRebuildRateHint();
+	stats.numStaticActors = m_scene->getNbActors(physx::PxActorTypeFlag::eRIGID_STATIC);
+	stats.numDynamicActors = m_scene->getNbActors(physx::PxActorTypeFlag::eRIGID_DYNAMIC);
+}
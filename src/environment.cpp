@@ -4,6 +4,7 @@
 
 #include <cinttypes>
 #include <limits>
+#include <algorithm>
 #include <pragma/entities/entity_component_manager.hpp>
 #include "pr_module.hpp"
 #include "pr_physx/environment.hpp"
@@ -16,6 +17,15 @@
 #include "pr_physx/vehicle.hpp"
 #include "pr_physx/sim_event_callback.hpp"
 #include "pr_physx/sim_filter_shader.hpp"
+#include "pr_physx/line_of_sight.hpp"
+#include "pr_physx/pose_history.hpp"
+#include "pr_physx/projectiles.hpp"
+#include "pr_physx/impact_damage.hpp"
+#include "pr_physx/contact_sounds.hpp"
+#include "pr_physx/sleep_state.hpp"
+#include "pr_physx/scene_query_layers.hpp"
+#include "pr_physx/query_profiler.hpp"
+#include "pr_physx/async.hpp"
 #include <sharedutils/util.h>
 #include <pragma/math/surfacematerial.h>
 #include <mathutil/transform.hpp>
@@ -35,10 +45,17 @@ pragma::physics::PhysXConstraint *pragma::physics::PhysXEnvironment::GetConstrai
 pragma::physics::PhysXActorShape *pragma::physics::PhysXEnvironment::GetShape(const physx::PxShape &shape) { return static_cast<pragma::physics::PhysXActorShape *>(shape.userData); }
 pragma::physics::PhysXController *pragma::physics::PhysXEnvironment::GetController(const physx::PxController &controller) { return static_cast<pragma::physics::PhysXController *>(controller.getUserData()); }
 pragma::physics::PhysXMaterial *pragma::physics::PhysXEnvironment::GetMaterial(const physx::PxBaseMaterial &material) { return static_cast<pragma::physics::PhysXMaterial *>(material.userData); }
-pragma::physics::PhysXEnvironment::PhysXEnvironment(NetworkState &state) : IEnvironment {state} {}
+static pragma::physics::PhysXSimulationFilterSettings g_defaultSimulationFilterSettings {};
+void pragma::physics::PhysXEnvironment::SetDefaultSimulationFilterSettings(const PhysXSimulationFilterSettings &settings) { g_defaultSimulationFilterSettings = settings; }
+const pragma::physics::PhysXSimulationFilterSettings &pragma::physics::PhysXEnvironment::GetDefaultSimulationFilterSettings() { return g_defaultSimulationFilterSettings; }
+pragma::physics::PhysXEnvironment::PhysXEnvironment(NetworkState &state) : IEnvironment {state}, m_sceneQuerySettings {GetDefaultSceneQuerySettings()}, m_simulationFilterSettings {GetDefaultSimulationFilterSettings()} {}
 
 void pragma::physics::PhysXEnvironment::OnRemove()
 {
+	if(m_asyncState) {
+		CompleteAsyncStep();
+		WaitForAsyncQueries();
+	}
 	IEnvironment::OnRemove();
 	m_controllerManager = nullptr;
 	m_scene = nullptr;
@@ -48,6 +65,13 @@ void pragma::physics::PhysXEnvironment::OnRemove()
 	m_controllerHitReport = nullptr;
 	m_simEventCallback = nullptr;
 	m_simFilterCallback = nullptr;
+	m_lineOfSightService = nullptr;
+	m_poseHistory = nullptr;
+	m_projectileSystem = nullptr;
+	m_impactDamageService = nullptr;
+	m_contactSoundService = nullptr;
+	m_sleepStateTracker = nullptr;
+	m_sceneQueryLayerAdapter = nullptr;
 }
 
 class PhysXErrorCallback : public physx::PxErrorCallback {
@@ -183,15 +207,17 @@ bool pragma::physics::PhysXEnvironment::Initialize()
 	m_cpuDispatcher = px_create_unique_ptr(physx::PxDefaultCpuDispatcherCreate(6)); // TODO: Should match number of available hardware threads
 	if(m_cpuDispatcher == nullptr)
 		return false;
-	m_simEventCallback = std::make_unique<PhysXSimulationEventCallback>();
+	m_simEventCallback = std::make_unique<PhysXSimulationEventCallback>(*this);
 	m_simFilterCallback = std::make_unique<PhysXSimulationFilterCallback>();
 	physx::PxSceneDesc sceneDesc {scale};
 	sceneDesc.gravity = {0.f, 0.f, 0.f};
 	sceneDesc.simulationEventCallback = m_simEventCallback.get();
 	sceneDesc.filterCallback = m_simFilterCallback.get();
-	sceneDesc.filterShader = PhysXSimulationFilterShader;
+	sceneDesc.filterShader = PhysXGetSimulationFilterShader(m_simulationFilterSettings);
+	sceneDesc.filterShaderData = &m_simulationFilterSettings;
+	sceneDesc.filterShaderDataSize = sizeof(m_simulationFilterSettings);
 	//sceneDesc.filterShader = VehicleFilterShader;
-	sceneDesc.kineKineFilteringMode = physx::PxPairFilteringMode::eDEFAULT;
+	sceneDesc.kineKineFilteringMode = physx::PxPairFilteringMode::eKEEP; // Required for ghost objects to detect kinematic objects
 	sceneDesc.staticKineFilteringMode = physx::PxPairFilteringMode::eDEFAULT;
 	sceneDesc.broadPhaseType = physx::PxBroadPhaseType::eABP;
 	sceneDesc.broadPhaseCallback = nullptr;
@@ -213,6 +239,22 @@ bool pragma::physics::PhysXEnvironment::Initialize()
 	// sceneDesc.ccdMaxSeparation; // TODO
 	// sceneDesc.solverOffsetSlop = 0.0;
 	sceneDesc.flags = physx::PxSceneFlag::eENABLE_CCD;
+	if(m_sceneQuerySettings.queryWhileSimulating)
+		sceneDesc.flags |= physx::PxSceneFlag::eREQUIRE_RW_LOCK;
+
+	sceneDesc.staticStructure = m_sceneQuerySettings.staticStructure;
+	sceneDesc.dynamicStructure = m_sceneQuerySettings.dynamicStructure;
+	sceneDesc.dynamicTreeSecondaryPruner = m_sceneQuerySettings.dynamicTreeSecondaryPruner;
+	sceneDesc.dynamicTreeRebuildRateHint = m_sceneQuerySettings.dynamicTreeRebuildRateHint;
+	sceneDesc.sceneQueryUpdateMode = m_sceneQuerySettings.updateMode;
+	if(m_sceneQuerySettings.layers.empty() == false) {
+		m_sceneQueryLayerAdapter = std::make_unique<PhysXSceneQueryLayerAdapter>(m_sceneQuerySettings.layers);
+		// Ownership of the scene query system is transferred to the scene
+		sceneDesc.sceneQuerySystem
+		  = m_sceneQueryLayerAdapter->CreateSceneQuerySystem(m_sceneQuerySettings.updateMode, m_sceneQuerySettings.staticStructure, m_sceneQuerySettings.dynamicStructure, m_sceneQuerySettings.dynamicTreeSecondaryPruner);
+		if(sceneDesc.sceneQuerySystem == nullptr)
+			return false;
+	}
 
 	m_scene = px_create_unique_ptr(g_pxPhysics->createScene(sceneDesc));
 	if(m_scene == nullptr)
@@ -226,6 +268,14 @@ bool pragma::physics::PhysXEnvironment::Initialize()
 
 	m_controllerBehaviorCallback = std::make_unique<CustomControllerBehaviorCallback>();
 	m_controllerHitReport = std::make_unique<CustomUserControllerHitReport>();
+	m_lineOfSightService = std::make_unique<PhysXLineOfSightService>(*this);
+	m_poseHistory = std::make_unique<PhysXPoseHistory>();
+	m_projectileSystem = std::make_unique<PhysXProjectileSystem>(*this);
+	m_impactDamageService = std::make_unique<PhysXImpactDamageService>();
+	m_contactSoundService = std::make_unique<PhysXContactSoundService>(*this);
+	m_sleepStateTracker = std::make_unique<PhysXSleepStateTracker>();
+	m_sceneQueryProfiler = std::make_unique<PhysXSceneQueryProfiler>();
+	m_asyncState = std::make_unique<PhysXAsyncState>();
 	return IEnvironment::Initialize();
 }
 pragma::physics::PhysXUniquePtr<pragma::physics::NoCollisionCategory> pragma::physics::PhysXEnvironment::GetUniqueNoCollisionCategory()
@@ -243,8 +293,16 @@ pragma::physics::PhysXUniquePtr<pragma::physics::NoCollisionCategory> pragma::ph
 	                                         }};
 	return cat;
 }
-void pragma::physics::PhysXEnvironment::StartProfiling() {}
-void pragma::physics::PhysXEnvironment::EndProfiling() {}
+void pragma::physics::PhysXEnvironment::StartProfiling()
+{
+	m_sceneQueryProfiler->Reset();
+	m_sceneQueryProfiler->SetEnabled(true);
+}
+void pragma::physics::PhysXEnvironment::EndProfiling()
+{
+	m_sceneQueryProfiler->SetEnabled(false);
+	Con::cout << "[PhysX] Scene query statistics:\n" << m_sceneQueryProfiler->GenerateReport() << Con::endl;
+}
 physx::PxVec3 pragma::physics::PhysXEnvironment::ToPhysXVector(const Vector3 &v) const { return physx::PxVec3 {v.x, v.y, v.z}; }
 physx::PxExtendedVec3 pragma::physics::PhysXEnvironment::ToPhysXExtendedVector(const Vector3 &v) const { return physx::PxExtendedVec3 {v.x, v.y, v.z}; }
 Vector3 pragma::physics::PhysXEnvironment::FromPhysXVector(const physx::PxExtendedVec3 &v) const { return Vector3 {static_cast<float>(v.x), static_cast<float>(v.y), static_cast<float>(v.z)}; }
@@ -260,6 +318,30 @@ Quat pragma::physics::PhysXEnvironment::FromPhysXRotation(const physx::PxQuat &v
 pragma::physics::PhysXRigidBody &pragma::physics::PhysXEnvironment::ToBtType(IRigidBody &body) { return dynamic_cast<PhysXRigidBody &>(body); }
 physx::PxVehicleDrivableSurfaceToTireFrictionPairs &pragma::physics::PhysXEnvironment::GetVehicleSurfaceTireFrictionPairs() const { return *m_surfaceTirePairs; }
 physx::PxScene &pragma::physics::PhysXEnvironment::GetScene() const { return *m_scene; }
+pragma::physics::PhysXLineOfSightService &pragma::physics::PhysXEnvironment::GetLineOfSightService() const { return *m_lineOfSightService; }
+pragma::physics::PhysXSceneQueryProfiler &pragma::physics::PhysXEnvironment::GetSceneQueryProfiler() const { return *m_sceneQueryProfiler; }
+pragma::physics::PhysXPoseHistory &pragma::physics::PhysXEnvironment::GetPoseHistory() const { return *m_poseHistory; }
+double pragma::physics::PhysXEnvironment::GetSimulationTime() const { return m_simulationTime; }
+pragma::physics::PhysXProjectileSystem &pragma::physics::PhysXEnvironment::GetProjectileSystem() const { return *m_projectileSystem; }
+pragma::physics::PhysXImpactDamageService &pragma::physics::PhysXEnvironment::GetImpactDamageService() const { return *m_impactDamageService; }
+pragma::physics::PhysXContactSoundService &pragma::physics::PhysXEnvironment::GetContactSoundService() const { return *m_contactSoundService; }
+pragma::physics::PhysXSleepStateTracker &pragma::physics::PhysXEnvironment::GetSleepStateTracker() const { return *m_sleepStateTracker; }
+void pragma::physics::PhysXEnvironment::SetSimulationFilterSettings(const PhysXSimulationFilterSettings &settings)
+{
+	auto &ops = m_simulationFilterSettings.filterOps;
+	if(m_scene && (settings.filterOps[0] != ops[0] || settings.filterOps[1] != ops[1] || settings.filterOps[2] != ops[2]))
+		Con::cwar << "[PhysX] Simulation filter ops cannot be changed after the scene has been created! Use SetDefaultSimulationFilterSettings instead." << Con::endl;
+	else
+		std::copy(std::begin(settings.filterOps), std::end(settings.filterOps), std::begin(ops));
+	m_simulationFilterSettings.filterConstants[0] = settings.filterConstants[0];
+	m_simulationFilterSettings.filterConstants[1] = settings.filterConstants[1];
+	m_simulationFilterSettings.filterBool = settings.filterBool;
+	if(m_scene == nullptr)
+		return;
+	SceneWriteScope lock {*this};
+	m_scene->setFilterShaderData(&m_simulationFilterSettings, sizeof(m_simulationFilterSettings));
+}
+const pragma::physics::PhysXSimulationFilterSettings &pragma::physics::PhysXEnvironment::GetSimulationFilterSettings() const { return m_simulationFilterSettings; }
 double pragma::physics::PhysXEnvironment::ToPhysXLength(double len) const { return len; }
 double pragma::physics::PhysXEnvironment::FromPhysXLength(double len) const { return len; }
 float pragma::physics::PhysXEnvironment::FromPhysXMass(float mass) const { return mass * umath::pow3(util::pragma::units_to_metres(1.f)); }
@@ -305,6 +387,8 @@ pragma::physics::IEnvironment::RemainingDeltaTime pragma::physics::PhysXEnvironm
 {
 	if(fixedTimeStep == 0.f)
 		return timeStep;
+	// An asynchronous step has to be completed before we can start a new one
+	CompleteAsyncStep();
 
 	for(auto &hController : GetControllers())
 		PhysXController::GetController(*hController).PreSimulate(timeStep);
@@ -315,18 +399,23 @@ pragma::physics::IEnvironment::RemainingDeltaTime pragma::physics::PhysXEnvironm
 		for(auto &vhc : GetVehicles())
 			PhysXVehicle::GetVehicle(*vhc).Simulate(fixedTimeStep);
 
-		m_scene->simulate(fixedTimeStep);
-		physx::PxU32 err;
-		auto success = m_scene->fetchResults(true, &err);
-		if(err)
-			;
+		BeginSubStep(fixedTimeStep);
+		// Wait without holding the scene lock, so other threads can keep
+		// querying the previous state while the simulation is running
+		m_scene->checkResults(true);
+		EndSubStep(fixedTimeStep);
+	}
+	if(numSubSteps > 0) {
+		SceneWriteScope lock {*this};
+		CommitSceneQueryUpdates();
 	}
 
-	for(auto &hController : GetControllers())
-		PhysXController::GetController(*hController).PostSimulate(timeStep);
+	FinalizeStep(timeStep);
+	m_asyncState->executor.RunPending();
 
 	auto *pVisDebugger = GetVisualDebugger();
 	if(pVisDebugger) {
+		SceneWriteScope lock {*this};
 		m_scene->setVisualizationParameter(physx::PxVisualizationParameter::eACTOR_AXES, 1.f);
 		m_scene->setVisualizationParameter(physx::PxVisualizationParameter::eBODY_AXES, 1.f);
 		m_scene->setVisualizationParameter(physx::PxVisualizationParameter::eCOLLISION_SHAPES, 1.f);
@@ -0,0 +1,137 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/impact_damage.hpp"
+#include "pr_physx/collision_object.hpp"
+#include "pr_physx/environment.hpp"
+#include <algorithm>
+
+void pragma::physics::PhysXImpactDamageService::AddBody(ICollisionObject &colObj, const BodySettings &settings)
+{
+	auto it = m_bodies.find(&colObj);
+	if(it != m_bodies.end() && it->second.handle.Get() == &colObj) {
+		it->second.settings = settings;
+		return;
+	}
+	auto &body = m_bodies[&colObj];
+	body = {};
+	body.handle = util::weak_shared_handle_cast<IBase, ICollisionObject>(colObj.GetHandle());
+	body.settings = settings;
+	// The contacts of the body have to be reported, even if contact reports are disabled for scripts
+	PhysXCollisionObject::GetCollisionObject(colObj).AddImpactReportListener();
+}
+void pragma::physics::PhysXImpactDamageService::RemoveBody(ICollisionObject &colObj)
+{
+	auto it = m_bodies.find(&colObj);
+	if(it == m_bodies.end())
+		return;
+	auto valid = (it->second.handle.Get() == &colObj);
+	m_bodies.erase(it);
+	auto itActive = std::find(m_activeBodies.begin(), m_activeBodies.end(), &colObj);
+	if(itActive != m_activeBodies.end())
+		m_activeBodies.erase(itActive);
+	if(valid)
+		PhysXCollisionObject::GetCollisionObject(colObj).RemoveImpactReportListener();
+}
+bool pragma::physics::PhysXImpactDamageService::HasBody(const ICollisionObject &colObj) const { return m_bodies.find(&colObj) != m_bodies.end(); }
+const pragma::physics::PhysXImpactDamageService::BodySettings *pragma::physics::PhysXImpactDamageService::GetBodySettings(const ICollisionObject &colObj) const
+{
+	auto it = m_bodies.find(&colObj);
+	return (it != m_bodies.end()) ? &it->second.settings : nullptr;
+}
+void pragma::physics::PhysXImpactDamageService::Clear()
+{
+	for(auto &pair : m_bodies) {
+		auto *colObj = pair.second.handle.Get();
+		if(colObj)
+			PhysXCollisionObject::GetCollisionObject(*colObj).RemoveImpactReportListener();
+	}
+	m_bodies.clear();
+	m_activeBodies.clear();
+}
+
+void pragma::physics::PhysXImpactDamageService::SetDamageCallback(const DamageCallback &callback) { m_damageCallback = callback; }
+const std::vector<pragma::physics::PhysXImpactDamageService::DamageEvent> &pragma::physics::PhysXImpactDamageService::GetDamageEvents() const { return m_events; }
+
+void pragma::physics::PhysXImpactDamageService::AccumulateImpulse(const ICollisionObject &colObj, ICollisionObject &other, float impulse, const Vector3 &position, const Vector3 &direction)
+{
+	auto it = m_bodies.find(&colObj);
+	// The address may have been re-used by a different object if the body was removed without unregistering it
+	if(it == m_bodies.end() || it->second.handle.Get() != &colObj)
+		return;
+	auto &body = it->second;
+	if(body.impulse == 0.f)
+		m_activeBodies.push_back(&colObj);
+	body.impulse += impulse;
+	body.weightedPosition += position * impulse;
+	body.weightedDirection += direction * impulse;
+
+	// Bodies usually only touch a handful of other bodies at once
+	auto itPair = std::find_if(body.pairs.begin(), body.pairs.end(), [&other](const PairImpulse &pair) { return pair.other == &other; });
+	if(itPair == body.pairs.end()) {
+		body.pairs.push_back({&other, util::weak_shared_handle_cast<IBase, ICollisionObject>(other.GetHandle())});
+		itPair = body.pairs.end() - 1;
+	}
+	itPair->impulse += impulse;
+}
+void pragma::physics::PhysXImpactDamageService::AddImpulse(ICollisionObject &colObj0, ICollisionObject &colObj1, float impulse, const Vector3 &position, const Vector3 &normal)
+{
+	if(impulse <= 0.f)
+		return;
+	AccumulateImpulse(colObj0, colObj1, impulse, position, normal);
+	AccumulateImpulse(colObj1, colObj0, impulse, position, -normal);
+}
+
+void pragma::physics::PhysXImpactDamageService::DispatchEvents()
+{
+	m_events.clear();
+	for(auto *colObj : m_activeBodies) {
+		auto it = m_bodies.find(colObj);
+		if(it == m_bodies.end())
+			continue;
+		auto &body = it->second;
+		auto impulse = body.impulse;
+		auto weightedPosition = body.weightedPosition;
+		auto weightedDirection = body.weightedDirection;
+		auto itMax = std::max_element(body.pairs.begin(), body.pairs.end(), [](const PairImpulse &a, const PairImpulse &b) { return a.impulse < b.impulse; });
+		auto other = (itMax != body.pairs.end()) ? itMax->otherHandle : util::TWeakSharedHandle<ICollisionObject> {};
+		body.impulse = 0.f;
+		body.weightedPosition = {};
+		body.weightedDirection = {};
+		body.pairs.clear();
+
+		auto *bodyObj = body.handle.Get();
+		if(bodyObj == nullptr) {
+			m_bodies.erase(it);
+			continue;
+		}
+		auto scaledImpulse = impulse;
+		if(body.settings.scaleByMass) {
+			auto &pxBodyObj = PhysXCollisionObject::GetCollisionObject(*bodyObj);
+			PhysXEnvironment::SceneReadScope lock {pxBodyObj.GetPxEnv()};
+			auto *rigidBody = pxBodyObj.GetInternalObject().is<physx::PxRigidBody>();
+			auto mass = rigidBody ? rigidBody->getMass() : 0.f;
+			// Static and kinematic bodies can't change their velocity
+			if(mass <= 0.f || rigidBody->getRigidBodyFlags().isSet(physx::PxRigidBodyFlag::eKINEMATIC))
+				continue;
+			scaledImpulse /= mass;
+		}
+		if(scaledImpulse <= body.settings.threshold)
+			continue;
+		m_events.push_back({});
+		auto &ev = m_events.back();
+		ev.collisionObject = body.handle;
+		ev.other = other;
+		ev.userData = body.settings.userData;
+		ev.impulse = impulse;
+		ev.damage = (scaledImpulse - body.settings.threshold) * body.settings.damageScale;
+		ev.position = weightedPosition / impulse;
+		ev.direction = uvec::get_normal(weightedDirection);
+	}
+	m_activeBodies.clear();
+	// Bodies that have been destroyed without being unregistered never receive impulses again, so they have to be pruned here
+	std::erase_if(m_bodies, [](const auto &pair) { return pair.second.handle.IsExpired(); });
+	if(m_events.empty() == false && m_damageCallback)
+		m_damageCallback(m_events);
+}
@@ -0,0 +1,150 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cinttypes>
+#include <limits>
+#include <algorithm>
+#include <pragma/entities/entity_component_manager.hpp>
+#include "pr_physx/line_of_sight.hpp"
+#include "pr_physx/environment.hpp"
+#include "pr_physx/collision_object.hpp"
+#include <mathutil/transform.hpp>
+
+namespace pragma::physics {
+	// Ignores the observer and the target, so only occluders in between can block the ray.
+	// Every other collision object blocks, regardless of whether it is a rigid body or not (e.g. controllers).
+	class LineOfSightFilterCallback : public physx::PxQueryFilterCallback {
+	  public:
+		LineOfSightFilterCallback(const PhysXCollisionObject *observer, const PhysXCollisionObject *target) : m_observer {observer}, m_target {target} {}
+		virtual physx::PxQueryHitType::Enum preFilter(const physx::PxFilterData &filterData, const physx::PxShape *shape, const physx::PxRigidActor *actor, physx::PxHitFlags &queryFlags) override
+		{
+			auto *colObj = actor ? PhysXEnvironment::GetCollisionObject(*actor) : nullptr;
+			return (colObj != nullptr && (colObj == m_observer || colObj == m_target)) ? physx::PxQueryHitType::eNONE : physx::PxQueryHitType::eBLOCK;
+		}
+		virtual physx::PxQueryHitType::Enum postFilter(const physx::PxFilterData &filterData, const physx::PxQueryHit &hit, const physx::PxShape *shape, const physx::PxRigidActor *actor) override { return physx::PxQueryHitType::eBLOCK; }
+	  private:
+		const PhysXCollisionObject *m_observer = nullptr;
+		const PhysXCollisionObject *m_target = nullptr;
+	};
+};
+
+pragma::physics::PhysXLineOfSightService::PhysXLineOfSightService(PhysXEnvironment &env) : m_env {env} {}
+
+pragma::physics::LineOfSightPairId pragma::physics::PhysXLineOfSightService::RegisterPair(const PairInfo &info)
+{
+	LineOfSightPairId pairId;
+	if(m_freePairIds.empty() == false) {
+		pairId = m_freePairIds.front();
+		m_freePairIds.pop();
+	}
+	else {
+		pairId = m_pairs.size();
+		m_pairs.push_back({});
+	}
+	auto &pair = m_pairs[pairId];
+	pair.info = info;
+	pair.result = {};
+	pair.active = true;
+	++m_numActivePairs;
+	return pairId;
+}
+void pragma::physics::PhysXLineOfSightService::UnregisterPair(LineOfSightPairId pairId)
+{
+	if(IsPairValid(pairId) == false)
+		return;
+	auto &pair = m_pairs[pairId];
+	pair = {};
+	m_freePairIds.push(pairId);
+	--m_numActivePairs;
+}
+bool pragma::physics::PhysXLineOfSightService::IsPairValid(LineOfSightPairId pairId) const { return pairId < m_pairs.size() && m_pairs[pairId].active; }
+void pragma::physics::PhysXLineOfSightService::SetPairPriority(LineOfSightPairId pairId, float priority)
+{
+	if(IsPairValid(pairId) == false)
+		return;
+	m_pairs[pairId].info.priority = priority;
+}
+const pragma::physics::PhysXLineOfSightService::Result *pragma::physics::PhysXLineOfSightService::GetResult(LineOfSightPairId pairId) const { return IsPairValid(pairId) ? &m_pairs[pairId].result : nullptr; }
+void pragma::physics::PhysXLineOfSightService::Invalidate(LineOfSightPairId pairId)
+{
+	if(IsPairValid(pairId) == false)
+		return;
+	m_pairs[pairId].result.valid = false;
+}
+
+void pragma::physics::PhysXLineOfSightService::SetQueryBudget(std::chrono::microseconds budget) { m_queryBudget = budget; }
+std::chrono::microseconds pragma::physics::PhysXLineOfSightService::GetQueryBudget() const { return m_queryBudget; }
+uint64_t pragma::physics::PhysXLineOfSightService::GetCurrentTick() const { return m_tick; }
+uint32_t pragma::physics::PhysXLineOfSightService::GetLastUpdateQueryCount() const { return m_lastUpdateQueryCount; }
+uint32_t pragma::physics::PhysXLineOfSightService::GetPairCount() const { return m_numActivePairs; }
+
+bool pragma::physics::PhysXLineOfSightService::Evaluate(Pair &pair)
+{
+	auto *observer = pair.info.observer.Get();
+	auto *target = pair.info.target.Get();
+	if(observer == nullptr || target == nullptr)
+		return false;
+	auto origin = m_env.ToPhysXVector(observer->GetWorldTransform() * pair.info.observerOffset);
+	auto dest = m_env.ToPhysXVector(target->GetWorldTransform() * pair.info.targetOffset);
+	auto unitDir = dest - origin;
+	auto distance = unitDir.magnitude();
+	if(distance == 0.f) {
+		pair.result.visible = true;
+		return true;
+	}
+	unitDir /= distance;
+
+	physx::PxQueryFilterData queryFilterData {physx::PxQueryFlag::eSTATIC | physx::PxQueryFlag::eDYNAMIC | physx::PxQueryFlag::ePREFILTER | physx::PxQueryFlag::eANY_HIT};
+	PhysXEnvironment::ApplyQueryCollisionMask(pair.info.mask, queryFilterData);
+	LineOfSightFilterCallback filter {&PhysXCollisionObject::GetCollisionObject(*observer), &PhysXCollisionObject::GetCollisionObject(*target)};
+	physx::PxRaycastBuffer hit {};
+	PhysXEnvironment::SceneReadScope lock {m_env};
+	// Observer and target are filtered out, so any hit is an occluder
+	pair.result.visible = !m_env.GetScene().raycast(origin, unitDir, distance, hit, physx::PxHitFlag::eMESH_ANY, queryFilterData, &filter);
+	return true;
+}
+
+uint32_t pragma::physics::PhysXLineOfSightService::Update()
+{
+	++m_tick;
+	m_lastUpdateQueryCount = 0;
+	if(m_numActivePairs == 0)
+		return 0;
+	m_updateOrder.clear();
+	m_updateOrder.reserve(m_numActivePairs);
+	for(auto i = decltype(m_pairs.size()) {0u}; i < m_pairs.size(); ++i) {
+		auto &pair = m_pairs[i];
+		if(pair.active == false)
+			continue;
+		// Pairs can never become valid again once the observer or the target has been removed
+		if(pair.info.observer.Get() == nullptr || pair.info.target.Get() == nullptr) {
+			UnregisterPair(i);
+			continue;
+		}
+		m_updateOrder.push_back(i);
+	}
+	if(m_updateOrder.empty())
+		return 0;
+	// Pairs that have never been evaluated (or have been invalidated) always come first,
+	// everything else is ordered by priority scaled by the number of ticks since the last update
+	auto getUrgency = [this](const Pair &pair) -> float {
+		if(pair.result.valid == false)
+			return std::numeric_limits<float>::max();
+		return pair.info.priority * static_cast<float>(m_tick - pair.result.lastUpdateTick);
+	};
+	std::sort(m_updateOrder.begin(), m_updateOrder.end(), [this, &getUrgency](LineOfSightPairId a, LineOfSightPairId b) { return getUrgency(m_pairs[a]) > getUrgency(m_pairs[b]); });
+
+	auto tStart = std::chrono::steady_clock::now();
+	for(auto pairId : m_updateOrder) {
+		if(std::chrono::steady_clock::now() - tStart >= m_queryBudget)
+			break;
+		auto &pair = m_pairs[pairId];
+		if(Evaluate(pair) == false)
+			continue;
+		pair.result.valid = true;
+		pair.result.lastUpdateTick = m_tick;
+		++m_lastUpdateQueryCount;
+	}
+	return m_lastUpdateQueryCount;
+}
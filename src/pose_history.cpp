@@ -0,0 +1,90 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/pose_history.hpp"
+#include "pr_physx/collision_object.hpp"
+#include "pr_physx/environment.hpp"
+#include <algorithm>
+
+std::vector<pragma::physics::PhysXPoseHistory::Track>::iterator pragma::physics::PhysXPoseHistory::FindTrack(const ICollisionObject &body)
+{
+	return std::find_if(m_tracks.begin(), m_tracks.end(), [&body](const Track &track) { return track.body.Get() == &body; });
+}
+std::vector<pragma::physics::PhysXPoseHistory::Track>::const_iterator pragma::physics::PhysXPoseHistory::FindTrack(const ICollisionObject &body) const { return const_cast<PhysXPoseHistory *>(this)->FindTrack(body); }
+
+bool pragma::physics::PhysXPoseHistory::AddBody(ICollisionObject &body)
+{
+	if(body.IsRigid() == false)
+		return false;
+	if(FindTrack(body) != m_tracks.end())
+		return true;
+	m_tracks.push_back({});
+	m_tracks.back().body = util::weak_shared_handle_cast<IBase, ICollisionObject>(body.GetHandle());
+	return true;
+}
+void pragma::physics::PhysXPoseHistory::RemoveBody(const ICollisionObject &body)
+{
+	auto it = FindTrack(body);
+	if(it == m_tracks.end())
+		return;
+	*it = std::move(m_tracks.back());
+	m_tracks.pop_back();
+}
+bool pragma::physics::PhysXPoseHistory::HasBody(const ICollisionObject &body) const { return FindTrack(body) != m_tracks.end(); }
+void pragma::physics::PhysXPoseHistory::Clear() { m_tracks.clear(); }
+
+void pragma::physics::PhysXPoseHistory::SetDuration(double duration) { m_duration = duration; }
+double pragma::physics::PhysXPoseHistory::GetDuration() const { return m_duration; }
+
+void pragma::physics::PhysXPoseHistory::Record(double time)
+{
+	for(auto it = m_tracks.begin(); it != m_tracks.end();) {
+		auto *body = it->body.Get();
+		// Bodies that have been removed from the world no longer have an actor and can't be traced against either
+		if(body == nullptr || PhysXCollisionObject::GetCollisionObject(*body).HasInternalObject() == false) {
+			it = m_tracks.erase(it);
+			continue;
+		}
+		auto &samples = it->samples;
+		auto &rigidBody = static_cast<const PhysXRigidBody &>(PhysXCollisionObject::GetCollisionObject(*body));
+		{
+			PhysXEnvironment::SceneReadScope lock {rigidBody.GetPxEnv()};
+			samples.push_back({time, rigidBody.GetInternalObject().getGlobalPose()});
+		}
+		// Keep one sample older than the duration, so the full range can still be interpolated
+		while(samples.size() > 2 && samples[1].time < time - m_duration)
+			samples.pop_front();
+		++it;
+	}
+}
+const std::vector<pragma::physics::PhysXPoseHistory::Track> &pragma::physics::PhysXPoseHistory::GetTracks() const { return m_tracks; }
+
+bool pragma::physics::PhysXPoseHistory::GetPose(const ICollisionObject &body, double time, physx::PxTransform &outPose) const
+{
+	auto it = FindTrack(body);
+	if(it == m_tracks.end())
+		return false;
+	return GetPose(*it, time, outPose);
+}
+bool pragma::physics::PhysXPoseHistory::GetPose(const Track &track, double time, physx::PxTransform &outPose)
+{
+	auto &samples = track.samples;
+	if(samples.empty())
+		return false;
+	auto itNext = std::upper_bound(samples.begin(), samples.end(), time, [](double time, const Sample &sample) { return time < sample.time; });
+	if(itNext == samples.begin()) {
+		outPose = samples.front().pose;
+		return true;
+	}
+	if(itNext == samples.end()) {
+		outPose = samples.back().pose;
+		return true;
+	}
+	auto &prev = *(itNext - 1);
+	auto &next = *itNext;
+	auto t = static_cast<float>((time - prev.time) / (next.time - prev.time));
+	outPose.p = prev.pose.p + (next.pose.p - prev.pose.p) * t;
+	outPose.q = physx::PxSlerp(t, prev.pose.q, next.pose.q);
+	return true;
+}
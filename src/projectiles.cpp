@@ -0,0 +1,239 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/projectiles.hpp"
+#include "pr_physx/environment.hpp"
+#include "pr_physx/collision_object.hpp"
+#include "pr_physx/shape.hpp"
+#include "pr_physx/material.hpp"
+#include <algorithm>
+
+static constexpr uint32_t PROJECTILE_BATCH_SIZE = 64;
+
+namespace {
+	// Ignores the actor of the projectile's owner
+	class ProjectileFilterCallback : public physx::PxQueryFilterCallback {
+	  public:
+		ProjectileFilterCallback(const physx::PxActor *ignore) : m_ignore {ignore} {}
+		virtual physx::PxQueryHitType::Enum preFilter(const physx::PxFilterData &filterData, const physx::PxShape *shape, const physx::PxRigidActor *actor, physx::PxHitFlags &queryFlags) override
+		{
+			return (actor == m_ignore) ? physx::PxQueryHitType::eNONE : physx::PxQueryHitType::eBLOCK;
+		}
+		virtual physx::PxQueryHitType::Enum postFilter(const physx::PxFilterData &filterData, const physx::PxQueryHit &hit, const physx::PxShape *shape, const physx::PxRigidActor *actor) override { return physx::PxQueryHitType::eBLOCK; }
+	  private:
+		const physx::PxActor *m_ignore = nullptr;
+	};
+};
+
+pragma::physics::PhysXProjectileSystem::PhysXProjectileSystem(PhysXEnvironment &env) : m_env {env} {}
+
+pragma::physics::ProjectileId pragma::physics::PhysXProjectileSystem::Spawn(const CreateInfo &createInfo)
+{
+	ProjectileId id;
+	if(m_freeIds.empty() == false) {
+		id = m_freeIds.front();
+		m_freeIds.pop();
+	}
+	else {
+		id = m_indices.size();
+		m_indices.push_back({});
+	}
+	m_indices[id] = m_ids.size();
+	m_positions.push_back(m_env.ToPhysXVector(createInfo.position));
+	m_velocities.push_back(m_env.ToPhysXVector(createInfo.velocity));
+	m_targetPositions.push_back(m_positions.back());
+	m_drag.push_back(createInfo.drag);
+	m_gravityScale.push_back(createInfo.gravityScale);
+	m_radius.push_back(static_cast<float>(m_env.ToPhysXLength(createInfo.radius)));
+	m_lifetime.push_back(createInfo.lifetime);
+	m_restitution.push_back(createInfo.restitution);
+	m_removeOnImpact.push_back(createInfo.removeOnImpact);
+	m_masks.push_back(createInfo.mask);
+	m_ignore.push_back(createInfo.ignore);
+	m_userData.push_back(createInfo.userData);
+	m_stepHits.push_back({});
+	m_ids.push_back(id);
+	return id;
+}
+void pragma::physics::PhysXProjectileSystem::RemoveAt(uint32_t index)
+{
+	// Swap with the last projectile to keep the arrays dense
+	auto last = m_ids.size() - 1;
+	if(index != last) {
+		m_positions[index] = m_positions[last];
+		m_velocities[index] = m_velocities[last];
+		m_targetPositions[index] = m_targetPositions[last];
+		m_drag[index] = m_drag[last];
+		m_gravityScale[index] = m_gravityScale[last];
+		m_radius[index] = m_radius[last];
+		m_lifetime[index] = m_lifetime[last];
+		m_restitution[index] = m_restitution[last];
+		m_removeOnImpact[index] = m_removeOnImpact[last];
+		m_masks[index] = m_masks[last];
+		m_ignore[index] = m_ignore[last];
+		m_userData[index] = m_userData[last];
+		m_stepHits[index] = m_stepHits[last];
+		m_ids[index] = m_ids[last];
+		m_indices[m_ids[index]] = index;
+	}
+	m_positions.pop_back();
+	m_velocities.pop_back();
+	m_targetPositions.pop_back();
+	m_drag.pop_back();
+	m_gravityScale.pop_back();
+	m_radius.pop_back();
+	m_lifetime.pop_back();
+	m_restitution.pop_back();
+	m_removeOnImpact.pop_back();
+	m_masks.pop_back();
+	m_ignore.pop_back();
+	m_userData.pop_back();
+	m_stepHits.pop_back();
+	m_ids.pop_back();
+}
+void pragma::physics::PhysXProjectileSystem::Remove(ProjectileId id)
+{
+	if(IsValid(id) == false)
+		return;
+	RemoveAt(m_indices[id]);
+	m_indices[id] = INVALID_PROJECTILE_ID;
+	m_freeIds.push(id);
+}
+bool pragma::physics::PhysXProjectileSystem::IsValid(ProjectileId id) const { return id < m_indices.size() && m_indices[id] != INVALID_PROJECTILE_ID; }
+uint32_t pragma::physics::PhysXProjectileSystem::GetCount() const { return m_ids.size(); }
+void pragma::physics::PhysXProjectileSystem::Clear()
+{
+	while(m_ids.empty() == false)
+		Remove(m_ids.back());
+}
+
+Vector3 pragma::physics::PhysXProjectileSystem::GetPosition(ProjectileId id) const { return IsValid(id) ? m_env.FromPhysXVector(m_positions[m_indices[id]]) : Vector3 {}; }
+Vector3 pragma::physics::PhysXProjectileSystem::GetVelocity(ProjectileId id) const { return IsValid(id) ? m_env.FromPhysXVector(m_velocities[m_indices[id]]) : Vector3 {}; }
+void pragma::physics::PhysXProjectileSystem::SetVelocity(ProjectileId id, const Vector3 &velocity)
+{
+	if(IsValid(id) == false)
+		return;
+	m_velocities[m_indices[id]] = m_env.ToPhysXVector(velocity);
+}
+
+void pragma::physics::PhysXProjectileSystem::SetImpactCallback(const ImpactCallback &callback) { m_impactCallback = callback; }
+const std::vector<pragma::physics::PhysXProjectileSystem::Impact> &pragma::physics::PhysXProjectileSystem::GetImpacts() const { return m_impacts; }
+
+void pragma::physics::PhysXProjectileSystem::SimulateRange(uint32_t start, uint32_t end, float timeStep, const physx::PxVec3 &gravity)
+{
+	auto &scene = m_env.GetScene();
+	auto hitFlags = physx::PxHitFlag::ePOSITION | physx::PxHitFlag::eNORMAL | physx::PxHitFlag::eFACE_INDEX;
+	for(auto i = start; i < end; ++i) {
+		auto &velocity = m_velocities[i];
+		velocity += gravity * (m_gravityScale[i] * timeStep);
+		velocity *= std::max(1.f - m_drag[i] * timeStep, 0.f);
+		auto &origin = m_positions[i];
+		auto &target = m_targetPositions[i];
+		target = origin + velocity * timeStep;
+
+		auto &stepHit = m_stepHits[i];
+		stepHit = {};
+		auto dir = target - origin;
+		auto distance = dir.magnitude();
+		if(distance == 0.f)
+			continue;
+		dir /= distance;
+
+		physx::PxQueryFilterData queryFilterData {physx::PxQueryFlag::eSTATIC | physx::PxQueryFlag::eDYNAMIC};
+		PhysXEnvironment::ApplyQueryCollisionMask(m_masks[i], queryFilterData);
+		// The ignored object may have been removed from the world, in which case it has no actor that could be hit anyway
+		auto *ignore = m_ignore[i].Get();
+		const physx::PxActor *ignoreActor = nullptr;
+		if(ignore) {
+			auto &ignoreObj = PhysXCollisionObject::GetCollisionObject(*ignore);
+			if(ignoreObj.HasInternalObject())
+				ignoreActor = &ignoreObj.GetInternalObject();
+		}
+		ProjectileFilterCallback filter {ignoreActor};
+		if(ignoreActor)
+			queryFilterData.flags |= physx::PxQueryFlag::ePREFILTER;
+
+		auto radius = m_radius[i];
+		if(radius == 0.f) {
+			physx::PxRaycastBuffer hit {};
+			if(scene.raycast(origin, dir, distance, hit, hitFlags, queryFilterData, &filter) && hit.hasBlock) {
+				target = hit.block.position;
+				stepHit = {hit.block.actor, hit.block.shape, hit.block.position, hit.block.normal, hit.block.faceIndex, true};
+			}
+		}
+		else {
+			physx::PxSweepBuffer hit {};
+			if(scene.sweep(physx::PxSphereGeometry {radius}, physx::PxTransform {origin}, dir, distance, hit, hitFlags, queryFilterData, &filter) && hit.hasBlock) {
+				// The projectile stops where the sphere touches the surface, not at the contact point itself
+				target = origin + dir * hit.block.distance;
+				stepHit = {hit.block.actor, hit.block.shape, hit.block.position, hit.block.normal, hit.block.faceIndex, true};
+			}
+		}
+	}
+}
+
+void pragma::physics::PhysXProjectileSystem::Simulate(float timeStep)
+{
+	if(m_ids.empty())
+		return;
+	auto &scene = m_env.GetScene();
+	{
+		// Pending scene query updates would otherwise be flushed lazily by the first worker thread
+		PhysXEnvironment::SceneWriteScope lock {m_env};
+		scene.flushQueryUpdates();
+	}
+	auto gravity = scene.getGravity();
+	// The projectile state is only modified per index, so the ranges can be processed in parallel
+	m_env.ParallelFor(m_ids.size(), PROJECTILE_BATCH_SIZE, [this, timeStep, &gravity](uint32_t start, uint32_t end) {
+		PhysXEnvironment::SceneReadScope lock {m_env};
+		SimulateRange(start, end, timeStep, gravity);
+	});
+
+	// Impacts and removals have to be handled sequentially. Iterating backwards ensures that
+	// swap-removals only move projectiles that have already been processed.
+	for(auto i = static_cast<int64_t>(m_ids.size()) - 1; i >= 0; --i) {
+		auto &stepHit = m_stepHits[i];
+		m_lifetime[i] -= timeStep;
+		if(stepHit.hit == false) {
+			m_positions[i] = m_targetPositions[i];
+			if(m_lifetime[i] <= 0.f)
+				Remove(m_ids[i]);
+			continue;
+		}
+		m_pendingImpacts.push_back({});
+		auto &impact = m_pendingImpacts.back();
+		impact.projectile = m_ids[i];
+		impact.userData = m_userData[i];
+		impact.position = m_env.FromPhysXVector(stepHit.position);
+		impact.normal = m_env.FromPhysXNormal(stepHit.normal);
+		impact.velocity = m_env.FromPhysXVector(m_velocities[i]);
+		auto *colObj = stepHit.actor ? PhysXEnvironment::GetCollisionObject(*stepHit.actor) : nullptr;
+		impact.collisionObject = colObj ? util::weak_shared_handle_cast<IBase, ICollisionObject>(colObj->GetHandle()) : util::TWeakSharedHandle<ICollisionObject> {};
+		if(stepHit.shape) {
+			auto *shape = PhysXEnvironment::GetShape(*stepHit.shape);
+			impact.shape = shape ? std::static_pointer_cast<IShape>(shape->GetShape().shared_from_this()) : nullptr;
+			auto *material = stepHit.shape->getMaterialFromInternalFaceIndex(stepHit.faceIndex);
+			impact.material = material ? std::static_pointer_cast<IMaterial>(PhysXEnvironment::GetMaterial(*material)->shared_from_this()) : nullptr;
+		}
+		impact.removed = m_removeOnImpact[i] || m_lifetime[i] <= 0.f;
+		if(impact.removed) {
+			Remove(m_ids[i]);
+			continue;
+		}
+		// Bounce off of the surface
+		auto &velocity = m_velocities[i];
+		auto normalVelocity = stepHit.normal * velocity.dot(stepHit.normal);
+		velocity = (velocity - normalVelocity) - normalVelocity * m_restitution[i];
+		// Small offset, so the next trace doesn't start on the surface
+		m_positions[i] = m_targetPositions[i] + stepHit.normal * 0.01f;
+	}
+}
+
+void pragma::physics::PhysXProjectileSystem::DispatchImpacts()
+{
+	m_impacts.clear();
+	std::swap(m_impacts, m_pendingImpacts);
+	if(m_impacts.empty() == false && m_impactCallback)
+		m_impactCallback(m_impacts);
+}
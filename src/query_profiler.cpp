@@ -0,0 +1,112 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/query_profiler.hpp"
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+static thread_local const char *t_currentTag = pragma::physics::PhysXSceneQueryProfiler::DEFAULT_TAG;
+static thread_local pragma::physics::PhysXSceneQueryProfiler::Sample *t_activeSample = nullptr;
+
+pragma::physics::PhysXSceneQueryProfiler::TagScope::TagScope(const char *tag) : m_prevTag {t_currentTag} { t_currentTag = tag; }
+pragma::physics::PhysXSceneQueryProfiler::TagScope::~TagScope() { t_currentTag = m_prevTag; }
+
+pragma::physics::PhysXSceneQueryProfiler::QueryScope::QueryScope(PhysXSceneQueryProfiler *profiler, QueryType type) : m_profiler {(profiler && profiler->IsEnabled()) ? profiler : nullptr}, m_type {type}
+{
+	if(m_profiler == nullptr)
+		return;
+	m_prevSample = t_activeSample;
+	t_activeSample = &m_sample;
+	m_tStart = std::chrono::steady_clock::now();
+}
+pragma::physics::PhysXSceneQueryProfiler::QueryScope::~QueryScope()
+{
+	if(m_profiler == nullptr)
+		return;
+	auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_tStart);
+	t_activeSample = m_prevSample;
+	m_profiler->Record(m_type, t_currentTag, m_sample, dt);
+}
+
+const char *pragma::physics::PhysXSceneQueryProfiler::GetCurrentTag() { return t_currentTag; }
+pragma::physics::PhysXSceneQueryProfiler::Sample *pragma::physics::PhysXSceneQueryProfiler::GetActiveSample() { return t_activeSample; }
+
+void pragma::physics::PhysXSceneQueryProfiler::SetEnabled(bool enabled) { m_enabled = enabled; }
+bool pragma::physics::PhysXSceneQueryProfiler::IsEnabled() const { return m_enabled; }
+void pragma::physics::PhysXSceneQueryProfiler::Reset()
+{
+	std::scoped_lock lock {m_statsMutex};
+	m_stats.clear();
+}
+void pragma::physics::PhysXSceneQueryProfiler::Record(QueryType type, const char *tag, const Sample &sample, std::chrono::nanoseconds duration)
+{
+	std::scoped_lock lock {m_statsMutex};
+	auto it = m_stats.find(tag);
+	if(it == m_stats.end())
+		it = m_stats.insert(std::make_pair(tag, std::array<Stats, static_cast<size_t>(QueryType::Count)> {})).first;
+	auto &stats = it->second[static_cast<size_t>(type)];
+	++stats.callCount;
+	stats.totalTime += duration;
+	stats.maxTime = std::max(stats.maxTime, duration);
+	stats.touchCount += sample.touchCount;
+	stats.preFilterCallCount += sample.preFilterCallCount;
+	stats.postFilterCallCount += sample.postFilterCallCount;
+	if(sample.touchBufferOverflow)
+		++stats.touchBufferOverflowCount;
+}
+std::vector<pragma::physics::PhysXSceneQueryProfiler::Entry> pragma::physics::PhysXSceneQueryProfiler::GetEntries(SortKey sortKey) const
+{
+	std::vector<Entry> entries {};
+	{
+		std::scoped_lock lock {m_statsMutex};
+		for(auto &pair : m_stats) {
+			for(auto i = decltype(pair.second.size()) {0u}; i < pair.second.size(); ++i) {
+				auto &stats = pair.second[i];
+				if(stats.callCount == 0)
+					continue;
+				entries.push_back({pair.first, static_cast<QueryType>(i), stats});
+			}
+		}
+	}
+	std::sort(entries.begin(), entries.end(), [sortKey](const Entry &a, const Entry &b) {
+		switch(sortKey) {
+		case SortKey::MaxTime:
+			return a.stats.maxTime > b.stats.maxTime;
+		case SortKey::CallCount:
+			return a.stats.callCount > b.stats.callCount;
+		case SortKey::TouchCount:
+			return a.stats.touchCount > b.stats.touchCount;
+		}
+		return a.stats.totalTime > b.stats.totalTime;
+	});
+	return entries;
+}
+static const char *get_query_type_name(pragma::physics::PhysXSceneQueryProfiler::QueryType type)
+{
+	switch(type) {
+	case pragma::physics::PhysXSceneQueryProfiler::QueryType::Overlap:
+		return "overlap";
+	case pragma::physics::PhysXSceneQueryProfiler::QueryType::RayCast:
+		return "raycast";
+	case pragma::physics::PhysXSceneQueryProfiler::QueryType::Sweep:
+		return "sweep";
+	}
+	return "unknown";
+}
+std::string pragma::physics::PhysXSceneQueryProfiler::GenerateReport(SortKey sortKey) const
+{
+	auto toMs = [](std::chrono::nanoseconds t) { return std::chrono::duration<double, std::milli>(t).count(); };
+	std::stringstream ss;
+	ss << std::left << std::setw(24) << "tag" << std::setw(10) << "type" << std::right << std::setw(10) << "calls" << std::setw(12) << "total (ms)" << std::setw(12) << "avg (ms)" << std::setw(12) << "max (ms)" << std::setw(10) << "touches"
+	   << std::setw(10) << "prefilter" << std::setw(11) << "postfilter" << std::setw(10) << "overflows" << "\n";
+	ss << std::fixed << std::setprecision(4);
+	for(auto &entry : GetEntries(sortKey)) {
+		auto &stats = entry.stats;
+		ss << std::left << std::setw(24) << entry.tag << std::setw(10) << get_query_type_name(entry.type) << std::right << std::setw(10) << stats.callCount << std::setw(12) << toMs(stats.totalTime) << std::setw(12)
+		   << (toMs(stats.totalTime) / static_cast<double>(stats.callCount)) << std::setw(12) << toMs(stats.maxTime) << std::setw(10) << stats.touchCount << std::setw(10) << stats.preFilterCallCount << std::setw(11)
+		   << stats.postFilterCallCount << std::setw(10) << stats.touchBufferOverflowCount << "\n";
+	}
+	return ss.str();
+}
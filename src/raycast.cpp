@@ -9,11 +9,22 @@
 #include "pr_physx/environment.hpp"
 #include "pr_physx/collision_object.hpp"
 #include "pr_physx/shape.hpp"
+#include "pr_physx/query_profiler.hpp"
 #include <pragma/physics/raytraces.h>
 
 pragma::physics::RayCastFilterCallback::RayCastFilterCallback(const pragma::physics::PhysXEnvironment &env, pragma::physics::IRayCastFilterCallback &rayCastFilterCallback, bool invertResult) : m_env {env}, m_rayCastFilterCallback {rayCastFilterCallback}, m_bInvertResult {invertResult} {}
-physx::PxQueryHitType::Enum pragma::physics::RayCastFilterCallback::preFilter(const physx::PxFilterData &filterData, const physx::PxShape *shape, const physx::PxRigidActor *actor, physx::PxHitFlags &queryFlags) { return Filter(shape, actor, &IRayCastFilterCallback::PreFilter); }
-physx::PxQueryHitType::Enum pragma::physics::RayCastFilterCallback::postFilter(const physx::PxFilterData &filterData, const physx::PxQueryHit &hit, const physx::PxShape *shape, const physx::PxRigidActor *actor) { return Filter(shape, actor, &IRayCastFilterCallback::PostFilter); }
+physx::PxQueryHitType::Enum pragma::physics::RayCastFilterCallback::preFilter(const physx::PxFilterData &filterData, const physx::PxShape *shape, const physx::PxRigidActor *actor, physx::PxHitFlags &queryFlags)
+{
+	if(auto *sample = PhysXSceneQueryProfiler::GetActiveSample())
+		++sample->preFilterCallCount;
+	return Filter(shape, actor, &IRayCastFilterCallback::PreFilter);
+}
+physx::PxQueryHitType::Enum pragma::physics::RayCastFilterCallback::postFilter(const physx::PxFilterData &filterData, const physx::PxQueryHit &hit, const physx::PxShape *shape, const physx::PxRigidActor *actor)
+{
+	if(auto *sample = PhysXSceneQueryProfiler::GetActiveSample())
+		++sample->postFilterCallCount;
+	return Filter(shape, actor, &IRayCastFilterCallback::PostFilter);
+}
 
 physx::PxQueryHitType::Enum pragma::physics::RayCastFilterCallback::Filter(const physx::PxShape *shape, const physx::PxRigidActor *actor, RayCastHitType (IRayCastFilterCallback::*filter)(IShape &, IRigidBody &) const)
 {
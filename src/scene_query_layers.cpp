@@ -0,0 +1,55 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/scene_query_layers.hpp"
+#include "pr_physx/environment.hpp"
+
+// Every layer has a static pruner followed by a dynamic pruner
+static uint32_t get_pruner_index(uint32_t layer, bool dynamic) { return layer * 2 + (dynamic ? 1 : 0); }
+static bool is_dynamic_pruner(uint32_t prunerIndex) { return (prunerIndex % 2) != 0; }
+
+pragma::physics::PhysXSceneQueryLayerAdapter::PhysXSceneQueryLayerAdapter(const std::vector<CollisionMask> &layers) : m_layers {layers}
+{
+	m_prunerGroups = std::make_unique<std::atomic<uint32_t>[]>(GetLayerCount() * 2);
+}
+physx::PxCustomSceneQuerySystem *pragma::physics::PhysXSceneQueryLayerAdapter::CreateSceneQuerySystem(physx::PxSceneQueryUpdateMode::Enum updateMode, physx::PxPruningStructureType::Enum staticStructure,
+  physx::PxPruningStructureType::Enum dynamicStructure, physx::PxDynamicTreeSecondaryPruner::Enum dynamicTreeSecondaryPruner) const
+{
+	auto *sqSystem = physx::PxCreateCustomSceneQuerySystem(updateMode, 0, *this);
+	if(sqSystem == nullptr)
+		return nullptr;
+	auto numLayers = GetLayerCount();
+	for(auto i = decltype(numLayers) {0u}; i < numLayers; ++i) {
+		sqSystem->addPruner(staticStructure, physx::PxDynamicTreeSecondaryPruner::eNONE);
+		sqSystem->addPruner(dynamicStructure, dynamicTreeSecondaryPruner);
+	}
+	return sqSystem;
+}
+uint32_t pragma::physics::PhysXSceneQueryLayerAdapter::GetLayer(CollisionMask group) const
+{
+	for(auto i = decltype(m_layers.size()) {0u}; i < m_layers.size(); ++i) {
+		if((umath::to_integral(m_layers[i]) & umath::to_integral(group)) != 0)
+			return i;
+	}
+	return m_layers.size();
+}
+uint32_t pragma::physics::PhysXSceneQueryLayerAdapter::GetLayerCount() const { return m_layers.size() + 1; }
+
+physx::PxU32 pragma::physics::PhysXSceneQueryLayerAdapter::getPrunerIndex(const physx::PxRigidActor &actor, const physx::PxShape &shape) const
+{
+	auto group = shape.getQueryFilterData().word0;
+	auto prunerIndex = get_pruner_index(GetLayer(static_cast<CollisionMask>(group)), actor.getType() != physx::PxActorType::eRIGID_STATIC);
+	m_prunerGroups[prunerIndex] |= group;
+	return prunerIndex;
+}
+bool pragma::physics::PhysXSceneQueryLayerAdapter::processPruner(physx::PxU32 prunerIndex, const physx::PxQueryThreadContext *context, const physx::PxQueryFilterData &filterData, physx::PxQueryFilterCallback *filterCall) const
+{
+	if(filterData.flags.isSet(is_dynamic_pruner(prunerIndex) ? physx::PxQueryFlag::eDYNAMIC : physx::PxQueryFlag::eSTATIC) == false)
+		return false;
+	// word0 only contains a collision mask for queries that have been flagged accordingly, other queries (e.g. the vehicle
+	// suspension raycasts) use it for the collision group instead, so their pruners can't be skipped
+	if((filterData.data.word2 & PhysXEnvironment::QUERY_FILTER_COLLISION_MASK_FLAG) == 0)
+		return true;
+	return (m_prunerGroups[prunerIndex] & filterData.data.word0) != 0;
+}
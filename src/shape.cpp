@@ -334,9 +334,11 @@ physx::PxShape &pragma::physics::PhysXActorShape::GetActorShape() const { return
 pragma::physics::PhysXActorShapeCollection::PhysXActorShapeCollection(PhysXCollisionObject &colObj) : m_collisionObject {colObj} {}
 pragma::physics::PhysXActorShape *pragma::physics::PhysXActorShapeCollection::AttachShapeToActor(PhysXShape &shape, PhysXMaterial &mat, const umath::Transform &localPose)
 {
-	if(m_collisionObject.IsRigid() == false)
+	// Ghost objects aren't rigid bodies, but their actor is still a rigid actor
+	auto *rigidActor = m_collisionObject.GetInternalObject().is<physx::PxRigidActor>();
+	if(rigidActor == nullptr)
 		return nullptr;
-	auto *pxActorShape = physx::PxRigidActorExt::createExclusiveShape(static_cast<PhysXRigidBody &>(m_collisionObject).GetInternalObject(), shape.GetInternalObject().any(), mat.GetInternalObject());
+	auto *pxActorShape = physx::PxRigidActorExt::createExclusiveShape(*rigidActor, shape.GetInternalObject().any(), mat.GetInternalObject());
 	auto pose = localPose * shape.GetLocalPose();
 	pxActorShape->setLocalPose(shape.GetPxEnv().CreatePxTransform(pose));
 	return AddShape(shape, *pxActorShape, true);
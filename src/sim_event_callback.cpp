@@ -8,7 +8,42 @@
 #include "pr_physx/material.hpp"
 #include "pr_physx/constraint.hpp"
 #include "pr_physx/collision_object.hpp"
+#include "pr_physx/impact_damage.hpp"
+#include "pr_physx/contact_sounds.hpp"
 #include <pragma/physics/contact.hpp>
+#include <algorithm>
+
+namespace {
+	// Most contact points of a pair share the same materials, so the handle is only looked up if the material changes
+	struct MaterialHandleCache {
+		const std::shared_ptr<pragma::physics::IMaterial> &Get(pragma::physics::PhysXMaterial *material)
+		{
+			if(material != m_material) {
+				m_material = material;
+				m_handle = material ? std::static_pointer_cast<pragma::physics::IMaterial>(material->shared_from_this()) : nullptr;
+			}
+			return m_handle;
+		}
+	  private:
+		pragma::physics::PhysXMaterial *m_material = nullptr;
+		std::shared_ptr<pragma::physics::IMaterial> m_handle = nullptr;
+	};
+};
+
+static uint32_t find_actor_shape_index(pragma::physics::ICollisionObject &colObj, const physx::PxShape &shape)
+{
+	auto &actorShapes = pragma::physics::PhysXCollisionObject::GetCollisionObject(colObj).GetActorShapeCollection().GetActorShapes();
+	auto it = std::find_if(actorShapes.begin(), actorShapes.end(), [&shape](const std::unique_ptr<pragma::physics::PhysXActorShape> &actorShape) { return &actorShape->GetActorShape() == &shape; });
+	return (it != actorShapes.end()) ? static_cast<uint32_t>(it - actorShapes.begin()) : std::numeric_limits<uint32_t>::max();
+}
+// Returns the shape handle if the shape at the index is still the one that was recorded
+static std::shared_ptr<pragma::physics::IShape> get_actor_shape_handle(pragma::physics::ICollisionObject &colObj, uint32_t index, const physx::PxShape *shape)
+{
+	auto &actorShapes = pragma::physics::PhysXCollisionObject::GetCollisionObject(colObj).GetActorShapeCollection().GetActorShapes();
+	if(index >= actorShapes.size() || &actorShapes[index]->GetActorShape() != shape)
+		return nullptr;
+	return std::static_pointer_cast<pragma::physics::IShape>(actorShapes[index]->GetShape().shared_from_this());
+}
 
 void pragma::physics::PhysXSimulationEventCallback::onConstraintBreak(physx::PxConstraintInfo *constraints, physx::PxU32 count)
 {
@@ -24,6 +59,8 @@ void pragma::physics::PhysXSimulationEventCallback::onConstraintBreak(physx::PxC
 
 void pragma::physics::PhysXSimulationEventCallback::onWake(physx::PxActor **actors, physx::PxU32 count)
 {
+	// Called from within fetchResults, the bodies are notified once the step has completed
+	auto &sleepStateTracker = m_env.GetSleepStateTracker();
 	for(auto i = decltype(count) {0u}; i < count; ++i) {
 		auto *actor = actors[i];
 		if(actor == nullptr)
@@ -35,12 +72,13 @@ void pragma::physics::PhysXSimulationEventCallback::onWake(physx::PxActor **acto
 		auto *pragmaActor = PhysXEnvironment::GetCollisionObject(*rigidActor);
 		if(pragmaActor == nullptr)
 			continue;
-		pragmaActor->OnWake();
+		sleepStateTracker.RecordTransition(*pragmaActor, pragmaActor->GetBodyId(), true);
 	}
 }
 
 void pragma::physics::PhysXSimulationEventCallback::onSleep(physx::PxActor **actors, physx::PxU32 count)
 {
+	auto &sleepStateTracker = m_env.GetSleepStateTracker();
 	for(auto i = decltype(count) {0u}; i < count; ++i) {
 		auto *actor = actors[i];
 		if(actor == nullptr)
@@ -52,52 +90,225 @@ void pragma::physics::PhysXSimulationEventCallback::onSleep(physx::PxActor **act
 		auto *pragmaActor = PhysXEnvironment::GetCollisionObject(*rigidActor);
 		if(pragmaActor == nullptr)
 			continue;
-		pragmaActor->OnSleep();
+		sleepStateTracker.RecordTransition(*pragmaActor, pragmaActor->GetBodyId(), false);
 	}
 }
 
+void pragma::physics::PhysXSimulationEventCallback::ContactBuffer::Clear()
+{
+	pairs.clear();
+	streams.clear();
+	rawPositions.clear();
+	rawNormals.clear();
+	rawImpulses.clear();
+	rawSeparations.clear();
+	faceIndices0.clear();
+	faceIndices1.clear();
+	positions.clear();
+	normals.clear();
+	impulses.clear();
+	distances.clear();
+	materials0.clear();
+	materials1.clear();
+}
+
+pragma::physics::PhysXSimulationEventCallback::PhysXSimulationEventCallback(PhysXEnvironment &env) : m_env {env} {}
+
 void pragma::physics::PhysXSimulationEventCallback::onContact(const physx::PxContactPairHeader &pairHeader, const physx::PxContactPair *pairs, physx::PxU32 nbPairs)
 {
+	// This is called from within fetchResults, so we only copy the raw contact data here. The events
+	// are dispatched later in DispatchContacts.
 	if(pairHeader.flags & (physx::PxContactPairHeaderFlag::eREMOVED_ACTOR_0 | physx::PxContactPairHeaderFlag::eREMOVED_ACTOR_1))
 		return;
 	auto *actor0 = pairHeader.actors[0] ? PhysXEnvironment::GetCollisionObject(*pairHeader.actors[0]) : nullptr;
-	if(actor0->IsContactReportEnabled() == false)
-		return;
 	auto *actor1 = pairHeader.actors[1] ? PhysXEnvironment::GetCollisionObject(*pairHeader.actors[1]) : nullptr;
 	if(actor0 == nullptr || actor1 == nullptr)
 		return;
-	auto &pxEnv = actor0->GetPxEnv();
+	// The filter shader requests touch found/lost notifications for all pairs, so the touching sets are maintained
+	// regardless of whether any of the objects has subscribed to contact reports.
+	// These flags are only set for one shape pair per actor pair, so the touching sets don't need any counting.
+	for(auto i = decltype(nbPairs) {0u}; i < nbPairs; ++i) {
+		auto &contactPair = pairs[i];
+		if(contactPair.flags & physx::PxContactPairFlag::eACTOR_PAIR_HAS_FIRST_TOUCH) {
+			actor0->AddTouchingObject(*actor1);
+			actor1->AddTouchingObject(*actor0);
+		}
+		else if(contactPair.flags & physx::PxContactPairFlag::eACTOR_PAIR_LOST_TOUCH) {
+			actor0->RemoveTouchingObject(*actor1);
+			actor1->RemoveTouchingObject(*actor0);
+		}
+	}
+
+	auto report0 = actor0->IsContactReportEnabled();
+	auto report1 = actor1->IsContactReportEnabled();
+	auto reportImpacts = actor0->IsImpactReportEnabled() || actor1->IsImpactReportEnabled();
+	if(report0 == false && report1 == false && reportImpacts == false)
+		return;
+	// Objects with a force threshold are only notified about threshold events, the touch events of the pair only exist for the touching sets
+	auto getReportEvents = [](const PhysXCollisionObject &o) -> physx::PxPairFlags {
+		if(umath::is_flag_set(o.m_contactReportFilterFlags, PhysXSimulationFilterFlags::ThresholdForce))
+			return physx::PxPairFlag::eNOTIFY_THRESHOLD_FORCE_FOUND | physx::PxPairFlag::eNOTIFY_THRESHOLD_FORCE_LOST;
+		return physx::PxPairFlag::eNOTIFY_TOUCH_FOUND | physx::PxPairFlag::eNOTIFY_TOUCH_LOST;
+	};
+	auto reportEvents0 = getReportEvents(*actor0);
+	auto reportEvents1 = getReportEvents(*actor1);
+	auto &buffer = m_contactBuffer;
 	for(auto i = decltype(nbPairs) {0u}; i < nbPairs; ++i) {
 		auto &contactPair = pairs[i];
 		if(contactPair.flags & (physx::PxContactPairFlag::eREMOVED_SHAPE_0 | physx::PxContactPairFlag::eREMOVED_SHAPE_1))
 			continue;
-		ContactInfo contactInfo {};
-		contactInfo.flags = ContactInfo::Flags::None;
+		ContactBuffer::Pair pair {};
 		if(contactPair.flags & physx::PxContactPairFlag::eACTOR_PAIR_HAS_FIRST_TOUCH)
-			contactInfo.flags |= ContactInfo::Flags::StartTouch;
+			pair.flags |= ContactInfo::Flags::StartTouch;
 		if(contactPair.flags & physx::PxContactPairFlag::eACTOR_PAIR_LOST_TOUCH)
-			contactInfo.flags |= ContactInfo::Flags::EndTouch;
-		contactInfo.shape0 = contactPair.shapes[0] ? std::static_pointer_cast<IShape>(PhysXEnvironment::GetShape(*contactPair.shapes[0])->GetShape().shared_from_this()) : nullptr;
-		contactInfo.shape1 = contactPair.shapes[1] ? std::static_pointer_cast<IShape>(PhysXEnvironment::GetShape(*contactPair.shapes[1])->GetShape().shared_from_this()) : nullptr;
-		contactInfo.collisionObj0 = util::weak_shared_handle_cast<IBase, ICollisionObject>(actor0->GetHandle());
-		contactInfo.collisionObj1 = util::weak_shared_handle_cast<IBase, ICollisionObject>(actor1->GetHandle());
-		std::vector<physx::PxContactPairPoint> contactPoints {contactPair.contactCount};
-		auto numContacts = contactPair.extractContacts(contactPoints.data(), contactPoints.size());
-		contactPoints.resize(numContacts);
-		contactInfo.contactPoints.reserve(numContacts);
-		for(auto &cp : contactPoints) {
-			contactInfo.contactPoints.push_back({});
-			auto &contactPoint = contactInfo.contactPoints.back();
-			contactPoint.impulse = pxEnv.FromPhysXVector(cp.impulse);
-			contactPoint.normal = pxEnv.FromPhysXNormal(cp.normal);
-			contactPoint.position = pxEnv.FromPhysXVector(cp.position);
-			contactPoint.distance = pxEnv.FromPhysXLength(cp.separation);
+			pair.flags |= ContactInfo::Flags::EndTouch;
+		pair.collisionObject0 = util::weak_shared_handle_cast<IBase, ICollisionObject>(actor0->GetHandle());
+		pair.collisionObject1 = util::weak_shared_handle_cast<IBase, ICollisionObject>(actor1->GetHandle());
+		pair.shape0 = contactPair.shapes[0];
+		pair.shape1 = contactPair.shapes[1];
+		pair.shapeIndex0 = find_actor_shape_index(*actor0, *pair.shape0);
+		pair.shapeIndex1 = find_actor_shape_index(*actor1, *pair.shape1);
+		pair.firstContact = buffer.rawPositions.size();
+
+		// Same as PxContactPair::extractContacts, but without the intermediate buffer. Only the raw data is
+		// copied here, everything else happens in ConvertContacts.
+		auto *impulses = contactPair.contactImpulses;
+		auto hasImpulses = (contactPair.flags & physx::PxContactPairFlag::eINTERNAL_HAS_IMPULSES);
+		auto flipped = (contactPair.flags & physx::PxContactPairFlag::eINTERNAL_CONTACTS_ARE_FLIPPED);
+		physx::PxContactStreamIterator it {contactPair.contactPatches, contactPair.contactPoints, contactPair.getInternalFaceIndices(), contactPair.patchCount, contactPair.contactCount};
+		uint32_t numContacts = 0;
+		while(it.hasNextPatch()) {
+			it.nextPatch();
+			while(it.hasNextContact()) {
+				it.nextContact();
+				buffer.rawPositions.push_back(it.getContactPoint());
+				buffer.rawNormals.push_back(it.getContactNormal());
+				buffer.rawImpulses.push_back(hasImpulses ? impulses[numContacts] : 0.f);
+				buffer.rawSeparations.push_back(it.getSeparation());
+				buffer.faceIndices0.push_back(flipped ? it.getFaceIndex1() : it.getFaceIndex0());
+				buffer.faceIndices1.push_back(flipped ? it.getFaceIndex0() : it.getFaceIndex1());
+				++numContacts;
+			}
+		}
+		pair.numContacts = numContacts;
+		buffer.streams.push_back({});
+		auto &stream = buffer.streams.back();
+		stream.collisionObject0 = actor0;
+		stream.collisionObject1 = actor1;
+		stream.shape0 = pair.shape0;
+		stream.shape1 = pair.shape1;
+		stream.firstContact = pair.firstContact;
+		stream.numContacts = pair.numContacts;
+		stream.reportImpacts = reportImpacts;
+		// Persistent contacts are only requested for native systems and are not reported to the objects
+		// Both objects share the same contact points
+		if(report0 && (contactPair.events & reportEvents0))
+			buffer.pairs.push_back(pair);
+		if(report1 && (contactPair.events & reportEvents1)) {
+			std::swap(pair.collisionObject0, pair.collisionObject1);
+			std::swap(pair.shape0, pair.shape1);
+			std::swap(pair.shapeIndex0, pair.shapeIndex1);
+			pair.flipped = true;
+			buffer.pairs.push_back(pair);
+		}
+	}
+}
+
+void pragma::physics::PhysXSimulationEventCallback::ConvertContacts(uint32_t startStream, uint32_t endStream)
+{
+	auto &buffer = m_contactBuffer;
+	for(auto streamIdx = startStream; streamIdx < endStream; ++streamIdx) {
+		auto &stream = buffer.streams[streamIdx];
+		stream.totalImpulse = 0.f;
+		stream.position = {};
+		stream.normal = {};
+		stream.material0 = nullptr;
+		stream.material1 = nullptr;
+		auto maxImpulse = -1.f;
+		for(auto i = stream.firstContact; i < stream.firstContact + stream.numContacts; ++i) {
+			auto &normal = buffer.rawNormals[i];
+			buffer.positions[i] = m_env.FromPhysXVector(buffer.rawPositions[i]);
+			buffer.normals[i] = m_env.FromPhysXNormal(normal);
+			buffer.impulses[i] = m_env.FromPhysXVector(normal * buffer.rawImpulses[i]);
+			buffer.distances[i] = m_env.FromPhysXLength(buffer.rawSeparations[i]);
+			auto *mat0 = stream.shape0->getMaterialFromInternalFaceIndex(buffer.faceIndices0[i]);
+			auto *mat1 = stream.shape1->getMaterialFromInternalFaceIndex(buffer.faceIndices1[i]);
+			buffer.materials0[i] = mat0 ? PhysXEnvironment::GetMaterial(*mat0) : nullptr;
+			buffer.materials1[i] = mat1 ? PhysXEnvironment::GetMaterial(*mat1) : nullptr;
+
+			auto impulse = uvec::length(buffer.impulses[i]);
+			if(impulse > maxImpulse) {
+				maxImpulse = impulse;
+				stream.material0 = buffer.materials0[i];
+				stream.material1 = buffer.materials1[i];
+			}
+			stream.totalImpulse += impulse;
+			stream.position += buffer.positions[i] * impulse;
+			stream.normal += buffer.normals[i] * impulse;
+		}
+		if(stream.totalImpulse > 0.f) {
+			stream.position /= stream.totalImpulse;
+			stream.normal = uvec::get_normal(stream.normal);
+		}
+	}
+}
 
-			auto *mat0 = contactPair.shapes[0]->getMaterialFromInternalFaceIndex(cp.internalFaceIndex0);
-			contactPoint.material0 = mat0 ? std::static_pointer_cast<IMaterial>(PhysXEnvironment::GetMaterial(*mat0)->shared_from_this()) : nullptr;
+void pragma::physics::PhysXSimulationEventCallback::DispatchContacts()
+{
+	auto &buffer = m_contactBuffer;
+	if(buffer.streams.empty())
+		return;
+	// Every stream only writes to its own range of contact points, so the streams can be converted in parallel
+	auto numContacts = buffer.rawPositions.size();
+	buffer.positions.resize(numContacts);
+	buffer.normals.resize(numContacts);
+	buffer.impulses.resize(numContacts);
+	buffer.distances.resize(numContacts);
+	buffer.materials0.resize(numContacts);
+	buffer.materials1.resize(numContacts);
+	m_env.ParallelFor(buffer.streams.size(), CONTACT_CONVERSION_BATCH_SIZE, [this](uint32_t start, uint32_t end) {
+		PhysXEnvironment::SceneReadScope lock {m_env};
+		ConvertContacts(start, end);
+	});
 
-			auto *mat1 = contactPair.shapes[1]->getMaterialFromInternalFaceIndex(cp.internalFaceIndex1);
-			contactPoint.material1 = mat1 ? std::static_pointer_cast<IMaterial>(PhysXEnvironment::GetMaterial(*mat1)->shared_from_this()) : nullptr;
+	// Impacts are aggregated before any callbacks are run, so all objects are still valid
+	auto &impactDamageService = m_env.GetImpactDamageService();
+	auto &contactSoundService = m_env.GetContactSoundService();
+	for(auto &stream : buffer.streams) {
+		if(stream.reportImpacts == false || stream.numContacts == 0)
+			continue;
+		impactDamageService.AddImpulse(*stream.collisionObject0, *stream.collisionObject1, stream.totalImpulse, stream.position, stream.normal);
+		contactSoundService.AddContact(*stream.collisionObject0, *stream.collisionObject1, stream.material0, stream.material1, stream.totalImpulse, stream.position, stream.normal);
+	}
+
+	MaterialHandleCache materialCache0 {};
+	MaterialHandleCache materialCache1 {};
+	auto &contactInfo = m_contactInfo;
+	for(auto &pair : buffer.pairs) {
+		// Objects may have been removed by the callbacks of a previous pair
+		auto *actor0 = pair.collisionObject0.Get();
+		auto *actor1 = pair.collisionObject1.Get();
+		if(actor0 == nullptr || actor1 == nullptr)
+			continue;
+		contactInfo.flags = pair.flags;
+		contactInfo.shape0 = get_actor_shape_handle(*actor0, pair.shapeIndex0, pair.shape0);
+		contactInfo.shape1 = get_actor_shape_handle(*actor1, pair.shapeIndex1, pair.shape1);
+		contactInfo.collisionObj0 = pair.collisionObject0;
+		contactInfo.collisionObj1 = pair.collisionObject1;
+		contactInfo.contactPoints.clear();
+		contactInfo.contactPoints.reserve(pair.numContacts);
+		auto sign = pair.flipped ? -1.f : 1.f;
+		auto &materials0 = pair.flipped ? buffer.materials1 : buffer.materials0;
+		auto &materials1 = pair.flipped ? buffer.materials0 : buffer.materials1;
+		for(auto i = pair.firstContact; i < pair.firstContact + pair.numContacts; ++i) {
+			contactInfo.contactPoints.push_back({});
+			auto &contactPoint = contactInfo.contactPoints.back();
+			contactPoint.impulse = buffer.impulses[i] * sign;
+			contactPoint.normal = buffer.normals[i] * sign;
+			contactPoint.position = buffer.positions[i];
+			contactPoint.distance = buffer.distances[i];
+			contactPoint.material0 = materialCache0.Get(materials0[i]);
+			contactPoint.material1 = materialCache1.Get(materials1[i]);
 		}
 		actor0->OnContact(contactInfo);
 
@@ -106,23 +317,88 @@ void pragma::physics::PhysXSimulationEventCallback::onContact(const physx::PxCon
 		if(umath::is_flag_set(contactInfo.flags, ContactInfo::Flags::EndTouch))
 			actor0->OnEndTouch(*actor1);
 	}
+	buffer.Clear();
+}
+
+void pragma::physics::PhysXSimulationEventCallback::QueueTriggerEvent(const TriggerPair &pair, ICollisionObject &trigger, ICollisionObject &other, bool startTouch)
+{
+	auto it = m_pendingTriggerEvents.find(pair);
+	if(it != m_pendingTriggerEvents.end()) {
+		auto &prevEvent = m_triggerEvents[it->second];
+		// If the object has left the trigger and re-entered it within the same step, neither event is dispatched
+		if(prevEvent.startTouch == false && startTouch) {
+			prevEvent.cancelled = true;
+			m_pendingTriggerEvents.erase(it);
+			return;
+		}
+	}
+	m_pendingTriggerEvents[pair] = m_triggerEvents.size();
+	m_triggerEvents.push_back({});
+	auto &ev = m_triggerEvents.back();
+	ev.trigger = util::weak_shared_handle_cast<IBase, ICollisionObject>(trigger.GetHandle());
+	ev.other = util::weak_shared_handle_cast<IBase, ICollisionObject>(other.GetHandle());
+	ev.startTouch = startTouch;
 }
 
 void pragma::physics::PhysXSimulationEventCallback::onTrigger(physx::PxTriggerPair *pairs, physx::PxU32 count)
 {
+	// This is called from within fetchResults, so the events are only collected here and dispatched in DispatchTriggers
 	for(auto i = decltype(count) {0u}; i < count; ++i) {
 		auto &triggerPair = pairs[i];
+		TriggerPair pair {triggerPair.triggerActor, triggerPair.otherActor};
+		auto startTouch = (triggerPair.status & physx::PxPairFlag::eNOTIFY_TOUCH_FOUND) != 0;
+		if(startTouch) {
+			// Only the first touching shape pair starts touching the actor
+			if(m_triggerShapePairCounts[pair]++ != 0)
+				continue;
+		}
+		else if(triggerPair.status & physx::PxPairFlag::eNOTIFY_TOUCH_LOST) {
+			// Touches are also lost if one of the shapes has been removed, which has to be counted as well
+			auto it = m_triggerShapePairCounts.find(pair);
+			if(it == m_triggerShapePairCounts.end() || --it->second > 0)
+				continue;
+			m_triggerShapePairCounts.erase(it);
+		}
+		else
+			continue;
+		// The touching sets of removed objects have already been cleared
 		if(triggerPair.flags & (physx::PxTriggerPairFlag::eREMOVED_SHAPE_TRIGGER | physx::PxTriggerPairFlag::eREMOVED_SHAPE_OTHER))
 			continue;
 		auto *triggerActor = triggerPair.triggerActor ? PhysXEnvironment::GetCollisionObject(*triggerPair.triggerActor) : nullptr;
 		auto *otherActor = triggerPair.otherActor ? PhysXEnvironment::GetCollisionObject(*triggerPair.otherActor) : nullptr;
 		if(triggerActor == nullptr || otherActor == nullptr)
 			continue;
-		if(triggerPair.status & physx::PxPairFlag::eNOTIFY_TOUCH_FOUND)
-			triggerActor->OnStartTouch(*otherActor);
-		if(triggerPair.status & physx::PxPairFlag::eNOTIFY_TOUCH_LOST)
-			triggerActor->OnEndTouch(*otherActor);
+		if(startTouch) {
+			triggerActor->AddTouchingObject(*otherActor);
+			otherActor->AddTouchingObject(*triggerActor);
+		}
+		else {
+			triggerActor->RemoveTouchingObject(*otherActor);
+			otherActor->RemoveTouchingObject(*triggerActor);
+		}
+		QueueTriggerEvent(pair, *triggerActor, *otherActor, startTouch);
+	}
+}
+
+void pragma::physics::PhysXSimulationEventCallback::DispatchTriggers()
+{
+	m_pendingTriggerEvents.clear();
+	if(m_triggerEvents.empty())
+		return;
+	for(auto &ev : m_triggerEvents) {
+		if(ev.cancelled)
+			continue;
+		// Objects may have been removed by the callbacks of a previous event
+		auto *trigger = ev.trigger.Get();
+		auto *other = ev.other.Get();
+		if(trigger == nullptr || other == nullptr)
+			continue;
+		if(ev.startTouch)
+			trigger->OnStartTouch(*other);
+		else
+			trigger->OnEndTouch(*other);
 	}
+	m_triggerEvents.clear();
 }
 
 void pragma::physics::PhysXSimulationEventCallback::onAdvance(const physx::PxRigidBody *const *bodyBuffer, const physx::PxTransform *poseBuffer, const physx::PxU32 count) {}
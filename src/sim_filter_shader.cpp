@@ -29,6 +29,9 @@
 
 #include "pr_physx/sim_filter_shader.hpp"
 #include "pr_physx/environment.hpp"
+#include <array>
+#include <utility>
+#include <type_traits>
 
 using namespace physx;
 
@@ -50,11 +53,8 @@ namespace pragma::physics {
 
 	//PhysXCollisionBitMap gCollisionTable[GROUP_SIZE][GROUP_SIZE];
 
-	PhysXFilterOp::Enum gFilterOps[3] = {PhysXFilterOp::PX_FILTEROP_AND, PhysXFilterOp::PX_FILTEROP_AND, PhysXFilterOp::PX_FILTEROP_AND};
-
-	PhysXGroupsMask gFilterConstants[2];
-
-	bool gFilterBool = false;
+	// PhysX copies the settings into the constant block of the scene
+	static_assert(std::is_trivially_copyable_v<PhysXSimulationFilterSettings>);
 
 	static void gAND(PhysXGroupsMask &results, const PhysXGroupsMask &mask0, const PhysXGroupsMask &mask1)
 	{
@@ -109,7 +109,8 @@ namespace pragma::physics {
 
 	typedef void (*FilterFunction)(PhysXGroupsMask &results, const PhysXGroupsMask &mask0, const PhysXGroupsMask &mask1);
 
-	FilterFunction const gTable[] = {gAND, gOR, gXOR, gNAND, gNOR, gNXOR, gSWAP_AND};
+	constexpr FilterFunction gTable[] = {gAND, gOR, gXOR, gNAND, gNOR, gNXOR, gSWAP_AND};
+	constexpr auto NUM_FILTER_OPS = static_cast<uint32_t>(std::size(gTable));
 
 	static physx::PxFilterData convert(const PhysXGroupsMask &mask)
 	{
@@ -125,8 +126,9 @@ namespace pragma::physics {
 	{
 		PhysXGroupsMask mask;
 
-		mask.bits0 = PxU16((fd.word2 & 0xffff));
-		mask.bits1 = PxU16((fd.word2 >> 16));
+		auto word2 = fd.word2 & ~umath::to_integral(PhysXSimulationFilterFlags::Mask);
+		mask.bits0 = PxU16((word2 & 0xffff));
+		mask.bits1 = PxU16((word2 >> 16));
 		mask.bits2 = PxU16((fd.word3 & 0xffff));
 		mask.bits3 = PxU16((fd.word3 >> 16));
 
@@ -161,7 +163,8 @@ namespace pragma::physics {
 	PX_FORCE_INLINE static void adjustFilterData(bool groupsMask, const physx::PxFilterData &src, physx::PxFilterData &dst)
 	{
 		if(groupsMask) {
-			dst.word2 = src.word2;
+			// Keep the contact report flags
+			dst.word2 = (src.word2 & ~umath::to_integral(PhysXSimulationFilterFlags::Mask)) | (dst.word2 & umath::to_integral(PhysXSimulationFilterFlags::Mask));
 			dst.word3 = src.word3;
 		}
 		else
@@ -201,18 +204,40 @@ namespace pragma::physics {
 }
 
 using namespace pragma::physics;
-physx::PxFilterFlags pragma::physics::PhysXSimulationFilterShader(physx::PxFilterObjectAttributes attributes0, physx::PxFilterData filterData0, physx::PxFilterObjectAttributes attributes1, physx::PxFilterData filterData1, physx::PxPairFlags &pairFlags, const void *constantBlock,
+// The filter ops are template arguments, so the filter functions are resolved at compile time instead of
+// being looked up for every pair
+template<PhysXFilterOp::Enum TOp0, PhysXFilterOp::Enum TOp1, PhysXFilterOp::Enum TOp2>
+static physx::PxFilterFlags PhysXSimulationFilterShader(physx::PxFilterObjectAttributes attributes0, physx::PxFilterData filterData0, physx::PxFilterObjectAttributes attributes1, physx::PxFilterData filterData1, physx::PxPairFlags &pairFlags, const void *constantBlock,
   physx::PxU32 constantBlockSize)
 {
-	PX_UNUSED(constantBlock);
 	PX_UNUSED(constantBlockSize);
+	auto &settings = *static_cast<const PhysXSimulationFilterSettings *>(constantBlock);
 
 	// let triggers through
-	if(PxFilterObjectIsTrigger(attributes0) || PxFilterObjectIsTrigger(attributes1)) {
+	auto isTrigger0 = PxFilterObjectIsTrigger(attributes0);
+	auto isTrigger1 = PxFilterObjectIsTrigger(attributes1);
+	if(isTrigger0 || isTrigger1) {
+		// Regular triggers only report dynamic objects, pairs with static and kinematic objects are discarded entirely.
+		// Ghost objects are the exception, they also track kinematic objects (e.g. character controllers).
+		auto otherAttributes = isTrigger0 ? attributes1 : attributes0;
+		if(PxGetFilterObjectType(otherAttributes) == PxFilterObjectType::eRIGID_STATIC)
+			return PxFilterFlag::eKILL;
+		auto &triggerFilterData = isTrigger0 ? filterData0 : filterData1;
+		auto isGhost = (triggerFilterData.word2 & umath::to_integral(PhysXSimulationFilterFlags::GhostObject)) != 0;
+		if(isGhost) {
+			if(PX_FILTER_SHOULD_PASS(filterData0, filterData1) == false)
+				return PxFilterFlag::eSUPPRESS;
+		}
+		else if(PxFilterObjectIsKinematic(otherAttributes))
+			return PxFilterFlag::eKILL;
 		pairFlags = PxPairFlag::eTRIGGER_DEFAULT;
 		return PxFilterFlags();
 	}
 
+	// Kinematic pairs are only kept for ghost objects, two kinematic objects never generate contacts
+	if(PxFilterObjectIsKinematic(attributes0) && PxFilterObjectIsKinematic(attributes1))
+		return PxFilterFlag::eSUPPRESS;
+
 	// Collision Group
 	/*if (!gCollisionTable[filterData0.word0][filterData1.word0]())
 	{
@@ -227,21 +252,59 @@ physx::PxFilterFlags pragma::physics::PhysXSimulationFilterShader(physx::PxFilte
 	pragma::physics::PhysXGroupsMask g1 = convert(filterData1);
 
 	pragma::physics::PhysXGroupsMask g0k0;
-	gTable[gFilterOps[0]](g0k0, g0, gFilterConstants[0]);
+	gTable[TOp0](g0k0, g0, settings.filterConstants[0]);
 	pragma::physics::PhysXGroupsMask g1k1;
-	gTable[gFilterOps[1]](g1k1, g1, gFilterConstants[1]);
+	gTable[TOp1](g1k1, g1, settings.filterConstants[1]);
 	pragma::physics::PhysXGroupsMask final;
-	gTable[gFilterOps[2]](final, g0k0, g1k1);
+	gTable[TOp2](final, g0k0, g1k1);
 
 	bool r = final.bits0 || final.bits1 || final.bits2 || final.bits3;
-	if(r != gFilterBool) {
+	if(r != settings.filterBool) {
 		return PxFilterFlag::eSUPPRESS;
 	}
 
-	pairFlags = PxPairFlag::eCONTACT_DEFAULT;
-
+	// Touch found/lost notifications are always requested, since they are required to keep the touching sets of the objects
+	// up to date. They don't contain any contact points unless one of the objects has subscribed to contact reports.
+	pairFlags = PxPairFlag::eCONTACT_DEFAULT | PxPairFlag::eNOTIFY_TOUCH_FOUND | PxPairFlag::eNOTIFY_TOUCH_LOST;
+
+	// Contact points are only generated for pairs where at least one of the objects has subscribed to them.
+	// Subscribers with a force threshold are notified through the threshold events instead of the touch events.
+	auto reportFlags0 = static_cast<PhysXSimulationFilterFlags>(filterData0.word2 & umath::to_integral(PhysXSimulationFilterFlags::ContactReportMask));
+	auto reportFlags1 = static_cast<PhysXSimulationFilterFlags>(filterData1.word2 & umath::to_integral(PhysXSimulationFilterFlags::ContactReportMask));
+	auto report0 = umath::is_flag_set(reportFlags0, PhysXSimulationFilterFlags::ReportContacts);
+	auto report1 = umath::is_flag_set(reportFlags1, PhysXSimulationFilterFlags::ReportContacts);
+	if(report0 == false && report1 == false)
+		return PxFilterFlags();
+	auto threshold0 = report0 && umath::is_flag_set(reportFlags0, PhysXSimulationFilterFlags::ThresholdForce);
+	auto threshold1 = report1 && umath::is_flag_set(reportFlags1, PhysXSimulationFilterFlags::ThresholdForce);
+	auto reportAll = (report0 && threshold0 == false) || (report1 && threshold1 == false);
+	auto persistent = umath::is_flag_set(reportFlags0 | reportFlags1, PhysXSimulationFilterFlags::ReportPersistentContacts);
+	pairFlags |= PxPairFlag::eNOTIFY_CONTACT_POINTS;
+	if(reportAll) {
+		if(persistent)
+			pairFlags |= PxPairFlag::eNOTIFY_TOUCH_PERSISTS;
+	}
+	if(threshold0 || threshold1) {
+		pairFlags |= PxPairFlag::eNOTIFY_THRESHOLD_FORCE_FOUND | PxPairFlag::eNOTIFY_THRESHOLD_FORCE_LOST;
+		if(persistent && reportAll == false)
+			pairFlags |= PxPairFlag::eNOTIFY_THRESHOLD_FORCE_PERSISTS;
+	}
 	return PxFilterFlags();
 }
+
+// One specialized filter shader for every combination of filter ops, indexed by op0 *NUM_FILTER_OPS^2 +op1 *NUM_FILTER_OPS +op2
+template<size_t... I>
+static constexpr std::array<physx::PxSimulationFilterShader, sizeof...(I)> create_filter_shader_table(std::index_sequence<I...>)
+{
+	return {&PhysXSimulationFilterShader<static_cast<PhysXFilterOp::Enum>(I / (NUM_FILTER_OPS * NUM_FILTER_OPS)), static_cast<PhysXFilterOp::Enum>((I / NUM_FILTER_OPS) % NUM_FILTER_OPS), static_cast<PhysXFilterOp::Enum>(I % NUM_FILTER_OPS)>...};
+}
+static constexpr auto g_filterShaderTable = create_filter_shader_table(std::make_index_sequence<NUM_FILTER_OPS * NUM_FILTER_OPS * NUM_FILTER_OPS> {});
+
+physx::PxSimulationFilterShader pragma::physics::PhysXGetSimulationFilterShader(const PhysXSimulationFilterSettings &settings)
+{
+	auto &ops = settings.filterOps;
+	return g_filterShaderTable[(ops[0] * NUM_FILTER_OPS + ops[1]) * NUM_FILTER_OPS + ops[2]];
+}
 /*
 bool pragma::physics::PhysXGetGroupCollisionFlag(const PxU16 group1, const PxU16 group2)
 {
@@ -272,36 +335,6 @@ void pragma::physics::PhysXSetGroup(physx::PxActor &actor, const PxU16 collision
 	setFilterData<false>(actor, fd);
 }
 
-void pragma::physics::PhysXGetFilterOps(pragma::physics::PhysXFilterOp::Enum &op0, pragma::physics::PhysXFilterOp::Enum &op1, pragma::physics::PhysXFilterOp::Enum &op2)
-{
-	op0 = gFilterOps[0];
-	op1 = gFilterOps[1];
-	op2 = gFilterOps[2];
-}
-
-void pragma::physics::PhysXSetFilterOps(const pragma::physics::PhysXFilterOp::Enum &op0, const pragma::physics::PhysXFilterOp::Enum &op1, const pragma::physics::PhysXFilterOp::Enum &op2)
-{
-	gFilterOps[0] = op0;
-	gFilterOps[1] = op1;
-	gFilterOps[2] = op2;
-}
-
-bool pragma::physics::PhysXGetFilterBool() { return gFilterBool; }
-
-void pragma::physics::PhysXSetFilterBool(const bool enable) { gFilterBool = enable; }
-
-void pragma::physics::PhysXGetFilterConstants(PhysXGroupsMask &c0, PhysXGroupsMask &c1)
-{
-	c0 = gFilterConstants[0];
-	c1 = gFilterConstants[1];
-}
-
-void pragma::physics::PhysXSetFilterConstants(const PhysXGroupsMask &c0, const PhysXGroupsMask &c1)
-{
-	gFilterConstants[0] = c0;
-	gFilterConstants[1] = c1;
-}
-
 PhysXGroupsMask pragma::physics::PhysXGetGroupsMask(const physx::PxActor &actor)
 {
 	PxFilterData fd;
@@ -0,0 +1,87 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/sleep_state.hpp"
+#include <bit>
+
+pragma::physics::PhysXSleepStateTracker::BodyId pragma::physics::PhysXSleepStateTracker::AllocateBodyId()
+{
+	if(m_freeBodyIds.empty() == false) {
+		auto id = m_freeBodyIds.back();
+		m_freeBodyIds.pop_back();
+		return id;
+	}
+	auto id = m_nextBodyId++;
+	if((id / 64) >= m_awakeBits.size())
+		m_awakeBits.push_back(0);
+	return id;
+}
+void pragma::physics::PhysXSleepStateTracker::ReleaseBodyId(BodyId id)
+{
+	if(id >= m_nextBodyId)
+		return;
+	SetAwake(id, false);
+	m_freeBodyIds.push_back(id);
+}
+uint32_t pragma::physics::PhysXSleepStateTracker::GetBodyIdCount() const { return m_nextBodyId; }
+
+bool pragma::physics::PhysXSleepStateTracker::IsAwake(BodyId id) const
+{
+	if(id >= m_nextBodyId)
+		return false;
+	return (m_awakeBits[id / 64] & (uint64_t {1} << (id % 64))) != 0;
+}
+void pragma::physics::PhysXSleepStateTracker::SetAwake(BodyId id, bool awake)
+{
+	if(id >= m_nextBodyId)
+		return;
+	auto &word = m_awakeBits[id / 64];
+	auto bit = uint64_t {1} << (id % 64);
+	if(awake)
+		word |= bit;
+	else
+		word &= ~bit;
+}
+const std::vector<uint64_t> &pragma::physics::PhysXSleepStateTracker::GetAwakeBits() const { return m_awakeBits; }
+uint32_t pragma::physics::PhysXSleepStateTracker::GetAwakeBodyCount() const
+{
+	uint32_t count = 0;
+	for(auto word : m_awakeBits)
+		count += std::popcount(word);
+	return count;
+}
+
+void pragma::physics::PhysXSleepStateTracker::RecordTransition(ICollisionObject &colObj, BodyId id, bool awake)
+{
+	if(id >= m_nextBodyId)
+		return;
+	SetAwake(id, awake);
+	m_pendingTransitions.push_back({util::weak_shared_handle_cast<IBase, ICollisionObject>(colObj.GetHandle()), id, awake});
+}
+void pragma::physics::PhysXSleepStateTracker::SetTransitionCallback(const TransitionCallback &callback) { m_transitionCallback = callback; }
+const std::vector<pragma::physics::PhysXSleepStateTracker::Transition> &pragma::physics::PhysXSleepStateTracker::GetTransitions() const { return m_transitions; }
+void pragma::physics::PhysXSleepStateTracker::DispatchTransitions()
+{
+	m_transitions.clear();
+	for(auto &transition : m_pendingTransitions) {
+		// Bodies may have been removed by the callbacks of a previous transition
+		auto *colObj = transition.collisionObject.Get();
+		if(colObj == nullptr)
+			continue;
+		// A body may wake up and fall asleep again within the same step (e.g. with substeps), in which case only
+		// the final state counts. This also skips bodies that have already been notified.
+		auto awake = IsAwake(transition.bodyId);
+		if(colObj->IsAwake() == awake)
+			continue;
+		if(awake)
+			colObj->OnWake();
+		else
+			colObj->OnSleep();
+		transition.awake = awake;
+		m_transitions.push_back(transition);
+	}
+	m_pendingTransitions.clear();
+	if(m_transitions.empty() == false && m_transitionCallback)
+		m_transitionCallback(m_transitions);
+}
@@ -0,0 +1,64 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+* License, v. 2.0. If a copy of the MPL was not distributed with this
+* file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "pr_physx/task.hpp"
+#include <PxPhysicsAPI.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+
+namespace pragma::physics {
+	struct ParallelForContext {
+		ParallelForContext(const std::function<void(uint32_t, uint32_t)> &fn, uint32_t numPending) : function {fn}, numPending {numPending} {}
+		void OnTaskCompleted()
+		{
+			std::scoped_lock lock {mutex};
+			if(--numPending == 0)
+				condition.notify_one();
+		}
+		void Wait()
+		{
+			std::unique_lock lock {mutex};
+			condition.wait(lock, [this]() { return numPending == 0; });
+		}
+		const std::function<void(uint32_t, uint32_t)> &function;
+		std::mutex mutex {};
+		std::condition_variable condition {};
+		uint32_t numPending = 0;
+	};
+	class ParallelForTask : public physx::PxLightCpuTask {
+	  public:
+		ParallelForTask(ParallelForContext &context, uint32_t start, uint32_t end) : m_context {context}, m_start {start}, m_end {end} {}
+		virtual void run() override { m_context.function(m_start, m_end); }
+		virtual void release() override { m_context.OnTaskCompleted(); }
+		virtual const char *getName() const override { return "pragma::physics::ParallelForTask"; }
+	  private:
+		ParallelForContext &m_context;
+		uint32_t m_start = 0;
+		uint32_t m_end = 0;
+	};
+};
+
+void pragma::physics::px_parallel_for(physx::PxCpuDispatcher &dispatcher, uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)> &fn)
+{
+	if(count == 0)
+		return;
+	batchSize = std::max(batchSize, 1u);
+	auto numBatches = (count + batchSize - 1) / batchSize;
+	if(numBatches == 1 || dispatcher.getWorkerCount() == 0) {
+		fn(0, count);
+		return;
+	}
+	ParallelForContext context {fn, numBatches - 1};
+	// Tasks must not be moved once they have been submitted
+	std::deque<ParallelForTask> tasks {};
+	for(auto i = decltype(numBatches) {1u}; i < numBatches; ++i) {
+		auto start = i * batchSize;
+		tasks.emplace_back(context, start, std::min(start + batchSize, count));
+		dispatcher.submitTask(tasks.back());
+	}
+	fn(0, std::min(batchSize, count));
+	context.Wait();
+}
@@ -30,6 +30,8 @@ void pragma::physics::PhysXVehicle::Simulate(float dt)
 {
 	if(IsSpawned() == false)
 		return;
+	// The suspension raycasts and the vehicle update modify the actor
+	PhysXEnvironment::SceneWriteScope lock {GetPxEnv()};
 	auto *vhc4w = static_cast<physx::PxVehicleDrive4W *>(m_vehicle.get());
 	auto *actor = vhc4w->getRigidDynamicActor();
 	if(actor == nullptr)